@@ -0,0 +1,298 @@
+/**
+ * This file is a part of QDocumentView Project.
+ * QDocumentView is a widget to render multi-page documents
+ * Copyright 2021-2022 Britanicus <marcusbritanicus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * at your option, any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ **/
+
+#include <QtTest>
+
+#include <qdocumentview/QDocument.hpp>
+#include <qdocumentview/QDocumentRenderer.hpp>
+
+/**
+ * Cost of the renderer calls made on the paint path, on a long document:
+ * each scroll step updates the visible pages, and requests the pages (or tiles) shown.
+ * The calls look up the page cache and walk the render queue, so both are populated:
+ * all the pages are cached as thumbnails, and a prefetch of every page is pending.
+ */
+
+/* Renders are held here while the benchmark runs, so that the queue stays full */
+class RenderGate {
+    public:
+        void open() {
+            QMutexLocker locker( &mMutex );
+
+            mOpen = true;
+            mOpened.wakeAll();
+        }
+
+        void close() {
+            QMutexLocker locker( &mMutex );
+
+            mOpen = false;
+        }
+
+        void pass() {
+            QMutexLocker locker( &mMutex );
+
+            while ( not mOpen ) {
+                mOpened.wait( &mMutex );
+            }
+        }
+
+    private:
+        QMutex mMutex;
+        QWaitCondition mOpened;
+        bool mOpen = true;
+};
+
+/* A blank A4 page: rendering it costs next to nothing */
+class BlankPage : public QDocumentPage {
+    public:
+        BlankPage( int pgNo, RenderGate *gate ) : QDocumentPage( pgNo ) {
+            mGate = gate;
+        }
+
+        void setPageData( void * ) {
+        }
+
+        QImage render( QSize size, QDocumentRenderOptions ) const {
+            mGate->pass();
+
+            QImage img( size, QImage::Format_RGB32 );
+
+            img.fill( Qt::white );
+
+            return img;
+        }
+
+        QImage render( qreal zoomFactor, QDocumentRenderOptions opts ) const {
+            return render( (pageSize() * zoomFactor).toSize(), opts );
+        }
+
+        QImage render( int dpiX, int dpiY, QDocumentRenderOptions opts ) const {
+            return render( QSize( pageSize().width() * dpiX / 72, pageSize().height() * dpiY / 72 ), opts );
+        }
+
+        QImage renderTile( QSize, QRect tile, QDocumentRenderOptions opts ) const {
+            return render( tile.size(), opts );
+        }
+
+        bool canRenderTiles() const {
+            return true;
+        }
+
+        QString pageText() const {
+            return QString();
+        }
+
+        QString text( QRectF ) const {
+            return QString();
+        }
+
+        QList<QRectF> search( QString, QDocumentRenderOptions ) const {
+            return QList<QRectF>();
+        }
+
+        QSizeF pageSize( qreal zoom = 1.0 ) const {
+            return QSizeF( 595, 842 ) * zoom;
+        }
+
+        QImage thumbnail() const {
+            return QImage();
+        }
+
+    private:
+        RenderGate *mGate;
+};
+
+class BlankDocument : public QDocument {
+    Q_OBJECT;
+
+    public:
+        BlankDocument( int pages, RenderGate *gate ) : QDocument( "blank.pdf" ) {
+            for ( int i = 0; i < pages; i++ ) {
+                mPages << new BlankPage( i, gate );
+            }
+
+            mStatus = Ready;
+        }
+
+        ~BlankDocument() {
+            /* Before the pages go: the size reader may still be querying them */
+            resetPageSizes();
+            qDeleteAll( mPages );
+        }
+
+        void setPassword( QString ) {
+        }
+
+        QString title() const {
+            return QString();
+        }
+
+        QString author() const {
+            return QString();
+        }
+
+        QString creator() const {
+            return QString();
+        }
+
+        QString producer() const {
+            return QString();
+        }
+
+        QString created() const {
+            return QString();
+        }
+
+    public Q_SLOTS:
+        void load() {
+        }
+
+        void close() {
+        }
+};
+
+class RendererBench : public QObject {
+    Q_OBJECT;
+
+    private Q_SLOTS:
+        void initTestCase();
+        void cleanupTestCase();
+
+        /* Scroll through the document a page at a time, requesting the visible pages */
+        void requestPage_data();
+        void requestPage();
+
+        /* The same, zoomed in: the visible tiles are requested, and those scrolled away are withdrawn */
+        void requestTile();
+
+    private:
+        RenderGate mGate;
+        BlankDocument *mDoc = nullptr;
+        QDocumentRenderer *mRenderer = nullptr;
+};
+
+/* Pages in the document, and pages visible at a time */
+static const int PageCount    = 1200;
+static const int VisibleCount = 3;
+
+/* Cached for each page, pending as a prefetch for each page, and shown zoomed in */
+static const QSize ThumbSize( 150, 212 );
+static const QSize PrefetchSize( 600, 848 );
+static const QSize ZoomedSize( 4096, 5793 );
+
+void RendererBench::initTestCase() {
+    mDoc      = new BlankDocument( PageCount, &mGate );
+    mRenderer = new QDocumentRenderer();
+
+    mRenderer->setDocument( mDoc );
+    mRenderer->setProgressivePreview( false );
+
+    /* Populate the cache: a thumbnail of every page */
+    int rendered = 0;
+
+    QMetaObject::Connection counter = connect(
+        mRenderer, &QDocumentRenderer::pageRendered, [ &rendered ] ( int ) {
+            rendered++;
+        }
+    );
+
+    for ( int pg = 0; pg < PageCount; pg++ ) {
+        mRenderer->requestPage( pg, ThumbSize, QDocumentRenderOptions(), QDocumentRenderer::ThumbnailPriority );
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT( rendered, PageCount, 60000 );
+    disconnect( counter );
+
+    /* Populate the queue: nothing is rendered from now on, so all the prefetches stay pending */
+    mGate.close();
+
+    QHash<int, QSize> prefetch;
+
+    for ( int pg = 0; pg < PageCount; pg++ ) {
+        prefetch[ pg ] = PrefetchSize;
+    }
+
+    mRenderer->prefetchPages( prefetch, QDocumentRenderOptions() );
+}
+
+
+void RendererBench::cleanupTestCase() {
+    /* Let the render that is held go, so that the renderer can shut down */
+    mGate.open();
+
+    delete mRenderer;
+    delete mDoc;
+}
+
+
+void RendererBench::requestPage_data() {
+    QTest::addColumn<QSize>( "size" );
+
+    /* A cache hit, and a request that is already queued */
+    QTest::newRow( "cached" ) << ThumbSize;
+    QTest::newRow( "queued" ) << PrefetchSize;
+}
+
+
+void RendererBench::requestPage() {
+    QFETCH( QSize, size );
+
+    QBENCHMARK {
+        for ( int first = 0; first <= PageCount - VisibleCount; first++ ) {
+            QHash<int, QRect> visible;
+
+            for ( int pg = first; pg < first + VisibleCount; pg++ ) {
+                visible[ pg ] = QRect( QPoint( 0, 0 ), size );
+            }
+
+            mRenderer->setVisiblePages( visible );
+
+            for ( int pg = first; pg < first + VisibleCount; pg++ ) {
+                mRenderer->requestPage( pg, size, QDocumentRenderOptions() );
+            }
+        }
+    }
+}
+
+
+void RendererBench::requestTile() {
+    /* The top of the page, as a 1920 x 1080 viewport shows it */
+    const QRect shown( 0, 0, 1920, 1080 );
+    const int   tile = mRenderer->tileSize();
+
+    QBENCHMARK {
+        for ( int pg = 0; pg < PageCount; pg++ ) {
+            mRenderer->setVisiblePages( { { pg, shown } } );
+
+            for ( int row = shown.top() / tile; row <= shown.bottom() / tile; row++ ) {
+                for ( int col = shown.left() / tile; col <= shown.right() / tile; col++ ) {
+                    mRenderer->requestTile( pg, ZoomedSize, QPoint( col, row ), QDocumentRenderOptions() );
+                }
+            }
+        }
+    }
+}
+
+
+QTEST_GUILESS_MAIN( RendererBench );
+
+#include "RendererBench.moc"
@@ -0,0 +1,207 @@
+/**
+ * This file is a part of QDocumentView Project.
+ * QDocumentView is a widget to render multi-page documents
+ * Copyright 2021-2022 Britanicus <marcusbritanicus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * at your option, any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ **/
+
+#include <QtTest>
+#include <QtWidgets>
+
+#include <qdocumentview/QDocumentView.hpp>
+#include <qdocumentview/QDocumentNavigation.hpp>
+
+/**
+ * Cost of a scroll step: with blitting, the painted contents are moved and only
+ * the exposed strip is painted; without it, the whole viewport is painted again.
+ * Runs on the offscreen platform, over a generated PDF of a thousand and more pages.
+ * Besides the time of a step, the view's own frame times are reported: those of the
+ * paintEvent(...) alone, as lastFrameTime() and averageFrameTime() give them.
+ */
+class PaintSpy : public QObject {
+    public:
+        QRegion painted;
+        int frames = 0;
+
+        bool eventFilter( QObject *, QEvent *event ) override {
+            if ( event->type() == QEvent::Paint ) {
+                painted += static_cast<QPaintEvent *>( event )->region();
+                frames++;
+            }
+
+            return false;
+        }
+};
+
+/* Pages in the generated document */
+static const int PageCount = 1200;
+
+class ScrollBench : public QObject {
+    Q_OBJECT;
+
+    private Q_SLOTS:
+        void initTestCase();
+        void cleanupTestCase();
+
+        /* The blit happens at all: the toolbar overlapping the viewport would disable it */
+        void blitRepaintsStrip();
+
+        /* Scroll by a step, and paint what it exposed */
+        void scrollStep_data();
+        void scrollStep();
+
+    private:
+        /* Scroll down by @dy, and let the view repaint */
+        void scrollBy( int dy );
+
+        QTemporaryDir mDir;
+        QDocumentView *mView = nullptr;
+};
+
+void ScrollBench::initTestCase() {
+    QVERIFY( mDir.isValid() );
+
+    const QString path = mDir.filePath( "scroll.pdf" );
+
+    /* A few lines of text on every page: something for the renderer to draw */
+    QPdfWriter writer( path );
+
+    writer.setPageSize( QPageSize( QPageSize::A4 ) );
+
+    QPainter painter( &writer );
+
+    for ( int pg = 0; pg < PageCount; pg++ ) {
+        if ( pg ) {
+            writer.newPage();
+        }
+
+        for ( int line = 0; line < 20; line++ ) {
+            painter.drawText( 0, line * 150, QString( "Page %1, line %2: the quick brown fox jumps over the lazy dog" ).arg( pg + 1 ).arg( line + 1 ) );
+        }
+    }
+
+    painter.end();
+
+    mView = new QDocumentView();
+    mView->resize( 800, 600 );
+    mView->setZoomMode( QDocumentView::FitToWidth );
+    mView->setLayoutContinuous( true );
+
+    QVERIFY( mView->load( path ) != nullptr );
+    QCOMPARE( mView->document()->pageCount(), PageCount );
+
+    mView->show();
+    QVERIFY( QTest::qWaitForWindowExposed( mView ) );
+
+    /* Let the visible pages render: the steps below should paint images, not placeholders */
+    QTest::qWait( 1000 );
+}
+
+
+void ScrollBench::cleanupTestCase() {
+    delete mView;
+}
+
+
+void ScrollBench::scrollBy( int dy ) {
+    QScrollBar *bar = mView->verticalScrollBar();
+
+    /* Wrap around at the end: the benchmark runs as many steps as it needs */
+    if ( bar->value() + dy > bar->maximum() ) {
+        bar->setValue( 0 );
+        qApp->processEvents();
+    }
+
+    bar->setValue( bar->value() + dy );
+    qApp->processEvents();
+}
+
+
+void ScrollBench::blitRepaintsStrip() {
+    mView->setScrollBlitting( true );
+
+    PaintSpy spy;
+
+    mView->viewport()->installEventFilter( &spy );
+    scrollBy( 20 );
+    mView->viewport()->removeEventFilter( &spy );
+
+    /* Area of the exposed strip and the band under the toolbar, against the whole viewport */
+    qint64 painted = 0;
+
+    for ( const QRect& rect: spy.painted ) {
+        painted += qint64( rect.width() ) * rect.height();
+    }
+
+    const QSize  size  = mView->viewport()->size();
+    const qint64 whole = qint64( size.width() ) * size.height();
+
+    QVERIFY2( painted < whole / 2, qPrintable( QString( "Painted %1 of %2 pixels: the scroll was not blitted" ).arg( painted ).arg( whole ) ) );
+}
+
+
+void ScrollBench::scrollStep_data() {
+    QTest::addColumn<bool>( "blitting" );
+    QTest::addColumn<int>( "startPage" );
+
+    /* Each mode scrolls through pages the other has not rendered: neither finds the other's in the cache */
+    QTest::newRow( "blit" )    << true << 0;
+    QTest::newRow( "repaint" ) << false << PageCount / 2;
+}
+
+
+void ScrollBench::scrollStep() {
+    QFETCH( bool, blitting );
+    QFETCH( int, startPage );
+
+    mView->setScrollBlitting( blitting );
+    mView->pageNavigation()->setCurrentPage( startPage );
+
+    /* Let the pages shown there render first */
+    QTest::qWait( 1000 );
+
+    PaintSpy spy;
+    qint64   frameTotal = 0;
+    int      frames     = 0;
+
+    mView->viewport()->installEventFilter( &spy );
+
+    QBENCHMARK {
+        scrollBy( 20 );
+
+        /* A frame was painted: the view timed it */
+        if ( spy.frames > frames ) {
+            frames = spy.frames;
+            frameTotal += mView->lastFrameTime();
+        }
+    }
+
+    mView->viewport()->removeEventFilter( &spy );
+
+    QVERIFY( frames > 0 );
+
+    qInfo(
+        "%s: %d frames, %.1f us per frame; last frame %lld us, running average %.1f us",
+        blitting ? "blit" : "repaint", frames, 1.0 * frameTotal / frames,
+        mView->lastFrameTime(), mView->averageFrameTime()
+    );
+}
+
+
+QTEST_MAIN( ScrollBench );
+
+#include "ScrollBench.moc"
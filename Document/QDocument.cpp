@@ -22,6 +22,8 @@
 #include <libgen.h>
 #include <qdocumentview/QDocument.hpp>
 
+#include "TextIndex.hpp"
+
 /**
  * Generic class to handle document
  */
@@ -47,6 +49,49 @@ QDocument::QDocument( QString path ) : QObject() {
             reload();
         }
     );
+
+    /* (Re)loaded: the text index is rebuilt only if the contents changed; in our thread, not the loader's */
+    connect(
+        this, &QDocument::statusChanged, this, [ = ]( QDocument::Status status ) {
+            const QSharedPointer<TextIndex> index = textIndex();
+
+            if ( (status == Ready) and index ) {
+                index->setDocument( fingerprint( mDocPath ), mPages.count() );
+            }
+        }
+    );
+}
+
+
+QDocument::~QDocument() {
+    /* The backends do it before they free their pages; this is for those that do not */
+    resetPageSizes();
+}
+
+
+QString QDocument::fingerprint( QString docPath ) {
+    QFile file( docPath );
+
+    if ( not file.open( QFile::ReadOnly ) ) {
+        return QString();
+    }
+
+    /* Reading the whole of a large document would take too long */
+    const qint64 chunk = 1024 * 1024;
+
+    QCryptographicHash hash( QCryptographicHash::Sha1 );
+
+    /* An edit in the middle that keeps the size is caught by the time */
+    hash.addData( QByteArray::number( file.size() ) );
+    hash.addData( QByteArray::number( QFileInfo( file ).lastModified().toMSecsSinceEpoch() ) );
+    hash.addData( file.read( chunk ) );
+
+    if ( file.size() > chunk ) {
+        file.seek( qMax( chunk, file.size() - chunk ) );
+        hash.addData( file.read( chunk ) );
+    }
+
+    return QString::fromLatin1( hash.result().toHex() );
 }
 
 
@@ -76,7 +121,106 @@ int QDocument::pageCount() const {
 
 
 QSizeF QDocument::pageSize( int pageNo ) const {
-    return mPages.at( pageNo )->pageSize() * mZoom;
+    return pageSizes().at( pageNo ) * mZoom;
+}
+
+
+QVector<QSizeF> QDocument::pageSizes() const {
+    /* The GUI thread lays the pages out while the pool threads render them */
+    QMutexLocker locker( &mPageSizesLock );
+
+    /* The pages were (re)loaded behind our back: stop reading the old ones first */
+    if ( (mPageSizes.count() != mPages.count()) and mSizeReader ) {
+        locker.unlock();
+        const_cast<QDocument *>( this )->resetPageSizes();
+        locker.relock();
+    }
+
+    if ( mPageSizes.count() != mPages.count() ) {
+        const QDocumentPages pages = mPages;
+
+        if ( pages.isEmpty() ) {
+            mPageSizes.clear();
+            return mPageSizes;
+        }
+
+        /* Opening a large document should not wait for every page: lay them out at page 0's size */
+        const QSizeF provisional = pages.at( 0 )->pageSize();
+
+        mPageSizes.fill( provisional, pages.count() );
+
+        if ( pages.count() > 1 ) {
+            const int generation = mSizeGeneration.loadAcquire();
+
+            mSizeReader = QThread::create(
+                [ this, pages, provisional, generation ] () {
+                    QDocument *doc = const_cast<QDocument *>( this );
+                    QElapsedTimer sinceChange;
+                    bool changed = false;
+
+                    sinceChange.start();
+
+                    for ( int i = 1; i < pages.count(); i++ ) {
+                        if ( mSizeGeneration.loadAcquire() != generation ) {
+                            return;
+                        }
+
+                        const QSizeF size = pages.at( i )->pageSize();
+
+                        if ( size == provisional ) {
+                            continue;
+                        }
+
+                        mPageSizesLock.lock();
+
+                        if ( (mSizeGeneration.loadAcquire() == generation) and (i < mPageSizes.count()) ) {
+                            mPageSizes[ i ] = size;
+                        }
+
+                        mPageSizesLock.unlock();
+                        changed = true;
+
+                        /* A relayout per page would keep the view busy: batch them */
+                        if ( sinceChange.elapsed() >= 200 ) {
+                            emit doc->pageSizesChanged();
+                            sinceChange.restart();
+                            changed = false;
+                        }
+                    }
+
+                    if ( changed and (mSizeGeneration.loadAcquire() == generation) ) {
+                        emit doc->pageSizesChanged();
+                    }
+                }
+            );
+
+            mSizeReader->start( QThread::LowPriority );
+        }
+    }
+
+    return mPageSizes;
+}
+
+
+void QDocument::resetPageSizes() {
+    /* The reader sees this before it queries the next page */
+    mSizeGeneration.fetchAndAddOrdered( 1 );
+
+    mPageSizesLock.lock();
+    QThread *reader = mSizeReader;
+
+    mSizeReader = nullptr;
+    mPageSizesLock.unlock();
+
+    /* Outside the lock: the reader takes it to store a size */
+    if ( reader ) {
+        reader->wait();
+        delete reader;
+    }
+
+    mPageSizesLock.lock();
+    mPageSizes.clear();
+    mPageSizesLock.unlock();
 }
 
 
@@ -84,6 +228,8 @@ void QDocument::reload() {
     emit documentReloading();
 
     mStatus = Null;
+
+    resetPageSizes();
     mPages.clear();
 
     load();
@@ -165,10 +311,31 @@ QString QDocument::text( int pageNo, QRectF rect ) const {
 
 
 QList<QRectF> QDocument::search( QString query, int pageNo, QDocumentRenderOptions opts ) const {
-    searchRects.clear();
+    /** Local: several pages may be searched at once, from different threads */
+    QList<QRectF> searchRects;
+
+    if ( pageNo >= 0 and pageNo < mPages.count() ) {
+        QDocumentPage *page = mPages.at( pageNo );
+        QList<QRectF> found;
+
+        /** Taken once: the index may be disabled from the GUI thread while we search */
+        const QSharedPointer<TextIndex> index = textIndex();
+
+        /** The index holds the unrotated text */
+        if ( index and page->hasTextLayout() and (opts.rotation() == QDocumentRenderOptions::Rotate0) ) {
+            /** Extract the text only once: later queries are answered from the index */
+            if ( not index->contains( pageNo ) ) {
+                index->insert( pageNo, page->textLayout() );
+            }
+
+            found = index->search( pageNo, query );
+        }
 
-    if ( pageNo >= 0 or pageNo < mPages.count() ) {
-        for ( QRectF rect: mPages.at( pageNo )->search( query, opts ) ) {
+        else {
+            found = page->search( query, opts );
+        }
+
+        for ( QRectF rect: found ) {
             searchRects << QRect( rect.x() * mZoom, rect.y() * mZoom, rect.width() * mZoom, rect.height() * mZoom );
         }
     }
@@ -177,12 +344,69 @@ QList<QRectF> QDocument::search( QString query, int pageNo, QDocumentRenderOptio
 }
 
 
+bool QDocument::textIndexEnabled() const {
+    return not textIndex().isNull();
+}
+
+
+void QDocument::setTextIndexEnabled( bool yes ) {
+    if ( yes == textIndexEnabled() ) {
+        return;
+    }
+
+    QSharedPointer<TextIndex> index;
+
+    /* Set up before it's published: searches see a complete index, or none */
+    if ( yes ) {
+        index = QSharedPointer<TextIndex>::create();
+        index->setDirectory( mPersistentIndex ? textIndexDirectory() : QString() );
+
+        if ( mStatus == Ready ) {
+            index->setDocument( fingerprint( mDocPath ), mPages.count() );
+        }
+    }
+
+    /* When disabling, the searches running still hold the old one: it goes with the last of them */
+    QMutexLocker locker( &mTextIndexLock );
+
+    mTextIndex = index;
+}
+
+
+QSharedPointer<TextIndex> QDocument::textIndex() const {
+    QMutexLocker locker( &mTextIndexLock );
+
+    return mTextIndex;
+}
+
+
+bool QDocument::textIndexPersistent() const {
+    return mPersistentIndex;
+}
+
+
+void QDocument::setTextIndexPersistent( bool yes ) {
+    mPersistentIndex = yes;
+
+    const QSharedPointer<TextIndex> index = textIndex();
+
+    if ( index ) {
+        index->setDirectory( mPersistentIndex ? textIndexDirectory() : QString() );
+    }
+}
+
+
+QString QDocument::textIndexDirectory() {
+    return QStandardPaths::writableLocation( QStandardPaths::GenericCacheLocation ) + "/qdocumentview/text";
+}
+
+
 qreal QDocument::zoomForWidth( int pageNo, qreal width ) const {
     if ( pageNo >= mPages.count() ) {
         return 0.0;
     }
 
-    return 1.0 * width / mPages.at( pageNo )->pageSize().width();
+    return 1.0 * width / pageSizes().at( pageNo ).width();
 }
 
 
@@ -191,7 +415,12 @@ qreal QDocument::zoomForHeight( int pageNo, qreal height ) const {
         return 0.0;
     }
 
-    return 1.0 * height / mPages.at( pageNo )->pageSize().height();
+    return 1.0 * height / pageSizes().at( pageNo ).height();
+}
+
+
+qreal QDocument::zoom() const {
+    return mZoom;
 }
 
 
@@ -212,3 +441,23 @@ QDocumentPage::QDocumentPage( int pgNo ) {
 int QDocumentPage::pageNo() {
     return mPageNo;
 }
+
+
+QImage QDocumentPage::renderTile( QSize size, QRect tile, QDocumentRenderOptions opts ) const {
+    return render( size, opts ).copy( tile );
+}
+
+
+bool QDocumentPage::canRenderTiles() const {
+    return false;
+}
+
+
+bool QDocumentPage::hasTextLayout() const {
+    return false;
+}
+
+
+QDocumentPageText QDocumentPage::textLayout() const {
+    return QDocumentPageText();
+}
@@ -24,11 +24,18 @@
 
 #include "RendererImpl.hpp"
 
-RenderTask::RenderTask( QDocumentPage *pg, QSize imgSz, QDocumentRenderOptions opts, qint64 id ) {
-    mPage    = pg;
-    mImgSize = imgSz;
-    mOpts    = opts;
-    mId      = id;
+#include <algorithm>
+
+RenderTask::RenderTask( QDocumentPage *pg, RenderKey key, QSize imgSz, QRect tile, QDocumentRenderOptions opts, qint64 id ) {
+    mPage     = pg;
+    mKey      = key;
+    mImgSize  = imgSz;
+    mTile     = tile;
+    mOpts     = opts;
+    mPriority = 0;
+    mId.storeRelaxed( id );
+
+    mThreadPriority = QThread::InheritPriority;
 }
 
 
@@ -44,7 +51,7 @@ int RenderTask::pageNumber() {
 
 
 qint64 RenderTask::requestId() {
-    return mId;
+    return mId.loadRelaxed();
 }
 
 
@@ -53,58 +60,643 @@ QSize RenderTask::imageSize() {
 }
 
 
+RenderKey RenderTask::key() {
+    return mKey;
+}
+
+
+int RenderTask::priority() {
+    return mPriority;
+}
+
+
+void RenderTask::setPriority( int priority ) {
+    mPriority = priority;
+}
+
+
+bool RenderTask::isThumbnail() {
+    return mThumbnail;
+}
+
+
+void RenderTask::setThumbnail( bool yes ) {
+    mThumbnail = yes;
+}
+
+
+void RenderTask::setThreadPriority( QThread::Priority priority ) {
+    mThreadPriority = priority;
+}
+
+
+void RenderTask::setDiskCache( DiskCache *cache, QString path ) {
+    mDiskCache = cache;
+    mCachePath = path;
+}
+
+
+void RenderTask::setQueue( RenderQueue *queue ) {
+    mQueue = queue;
+}
+
+
 void RenderTask::invalidate() {
     /* Set the request ID to -1. */
-    mId = -1;
+    mId.storeRelaxed( -1 );
 }
 
 
 void RenderTask::run() {
-    /* If this task has been invalidated */
-    if ( mId < 0 ) {
+    QImage img;
+
+    /* Pool threads are shared: apply the priority requested by our renderer, and restore it when done */
+    QThread                *thread      = QThread::currentThread();
+    const QThread::Priority oldPriority = thread->priority();
+
+    if ( mThreadPriority != QThread::InheritPriority ) {
+        thread->setPriority( mThreadPriority );
+    }
+
+    /* Rendered in an earlier session */
+    bool fromDisk = false;
+
+    if ( mDiskCache and (mId.loadRelaxed() > 0) ) {
+        img      = mDiskCache->load( mCachePath );
+        fromDisk = not img.isNull();
+    }
+
+    /* Render only if this task is still valid, and the page exists */
+    if ( img.isNull() and (mId.loadRelaxed() > 0) and (mPage != nullptr) ) {
+        /** The size is pre-rotated for the given rotation. */
+        QSize tgtSize;
+        switch ( mOpts.rotation() ) {
+            case QDocumentRenderOptions::Rotate0: {
+                tgtSize = QSize( mImgSize.width(), mImgSize.height() );
+                break;
+            }
+
+            case QDocumentRenderOptions::Rotate90: {
+                tgtSize = QSize( mImgSize.height(), mImgSize.width() );
+                break;
+            }
+
+            case QDocumentRenderOptions::Rotate180: {
+                tgtSize = QSize( mImgSize.width(), mImgSize.height() );
+                break;
+            }
+
+            case QDocumentRenderOptions::Rotate270: {
+                tgtSize = QSize( mImgSize.height(), mImgSize.width() );
+                break;
+            }
+        }
+
+        /** Render only the part of the page covered by the tile */
+        if ( mTile.isValid() ) {
+            img = mPage->renderTile( tgtSize, mTile, mOpts );
+        }
+
+        else {
+            img = mPage->render( tgtSize, mOpts );
+        }
+    }
+
+    /**
+     * Convert once, here, to a format the backing store blits without conversion:
+     * otherwise, QPainter::drawImage(...) converts the image on every paint.
+     */
+    if ( not img.isNull() ) {
+        const QImage::Format fmt = (img.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+
+        if ( img.format() != fmt ) {
+            img = img.convertToFormat( fmt );
+        }
+
+        /* Neither the backend nor the PNG on the disk knows the ratio */
+        img.setDevicePixelRatio( mKey.dpr );
+    }
+
+    /* Once we report back, the renderer may delete us: only locals from there on */
+    DiskCache              *cache    = mDiskCache;
+    const QString           path     = mCachePath;
+    const qint64            id       = mId.loadRelaxed();
+    const QThread::Priority priority = mThreadPriority;
+    RenderQueue            *queue    = mQueue;
+
+    /* Always report back: an invalid id tells the renderer to discard the image */
+    emit imageReady( mKey, img, id );
+
+    /* Save it for the next session: after reporting back, so that the image is shown sooner */
+    if ( cache and not fromDisk and not img.isNull() and (id > 0) ) {
+        cache->store( path, img );
+    }
+
+    /* A thread that was never given a priority reports InheritPriority, which cannot be set back */
+    if ( priority != QThread::InheritPriority ) {
+        thread->setPriority( oldPriority == QThread::InheritPriority ? QThread::NormalPriority : oldPriority );
+    }
+
+    /* The renderer may be waiting for us before it goes away */
+    if ( queue ) {
+        queue->taskDone();
+    }
+}
+
+
+RenderQueue::RenderQueue( QThreadPool *pool ) {
+    mPool = pool;
+}
+
+
+QThreadPool * RenderQueue::pool() const {
+    return mPool;
+}
+
+
+void RenderQueue::setPool( QThreadPool *pool ) {
+    if ( mPool == pool ) {
         return;
     }
 
-    /* If this page is null, do nothing */
-    if ( mPage == nullptr ) {
+    for ( RenderTask *task: pending.values() ) {
+        /* Running tasks will finish in the old pool */
+        if ( mPool->tryTake( task ) ) {
+            pool->start( task, task->priority() );
+        }
+    }
+
+    mPool = pool;
+}
+
+
+bool RenderQueue::contains( const RenderKey& key ) const {
+    return pending.contains( key );
+}
+
+
+RenderTask * RenderQueue::task( const RenderKey& key ) const {
+    return pending.value( key, nullptr );
+}
+
+
+QList<RenderKey> RenderQueue::keys() const {
+    return pending.keys();
+}
+
+
+QList<RenderKey> RenderQueue::keys( int pg ) const {
+    return byPage.values( pg );
+}
+
+
+void RenderQueue::enqueue( const RenderKey& key, RenderTask *task, int priority ) {
+    pending.insert( key, task );
+    byPage.insert( key.page, key );
+    mLive.insert( task );
+
+    task->setPriority( priority );
+    task->setQueue( this );
+
+    mRunLock.lock();
+    mOutstanding++;
+    mRunLock.unlock();
+
+    /* The thread pool runs the higher priority tasks first */
+    pool()->start( task, priority );
+}
+
+
+void RenderQueue::reprioritize( const RenderKey& key, int priority ) {
+    RenderTask *task = pending.value( key, nullptr );
+
+    if ( (task == nullptr) or (task->priority() == priority) ) {
         return;
     }
 
-    /** The size is pre-rotated for the given rotation. */
-    QSize tgtSize;
-    switch ( mOpts.rotation() ) {
-        case QDocumentRenderOptions::Rotate0: {
-            tgtSize = QSize( mImgSize.width(), mImgSize.height() );
-            break;
+    /* Already running: nothing to be done */
+    if ( not pool()->tryTake( task ) ) {
+        return;
+    }
+
+    task->setPriority( priority );
+    pool()->start( task, priority );
+}
+
+
+void RenderQueue::cancel( const RenderKey& key ) {
+    RenderTask *task = pending.take( key );
+
+    if ( task == nullptr ) {
+        return;
+    }
+
+    byPage.remove( key.page, key );
+
+    /* Not started yet: take it out of the pool, and delete it */
+    if ( pool()->tryTake( task ) ) {
+        mLive.remove( task );
+        delete task;
+
+        QMutexLocker locker( &mRunLock );
+        mOutstanding--;
+        mRunDone.wakeAll();
+
+        return;
+    }
+
+    /* Already running: it will report back with an invalid id, and will be deleted then */
+    task->invalidate();
+}
+
+
+bool RenderQueue::finished( const RenderKey& key, RenderTask *task ) {
+    /* This task was cancelled, or superseded by another request */
+    if ( pending.value( key, nullptr ) != task ) {
+        return false;
+    }
+
+    pending.remove( key );
+    byPage.remove( key.page, key );
+
+    return true;
+}
+
+
+void RenderQueue::clear() {
+    for ( const RenderKey& key: pending.keys() ) {
+        cancel( key );
+    }
+}
+
+
+void RenderQueue::release( RenderTask *task ) {
+    mLive.remove( task );
+}
+
+
+void RenderQueue::taskDone() {
+    QMutexLocker locker( &mRunLock );
+
+    mOutstanding--;
+    mRunDone.wakeAll();
+}
+
+
+void RenderQueue::shutdown() {
+    mRunLock.lock();
+
+    while ( mOutstanding > 0 ) {
+        mRunDone.wait( &mRunLock );
+    }
+
+    mRunLock.unlock();
+
+    /* Their reports are queued for a renderer that is going away: they will never be delivered */
+    qDeleteAll( mLive );
+    mLive.clear();
+}
+
+
+PageCache::PageCache( qint64 budget ) {
+    mBudget = budget;
+}
+
+
+bool PageCache::contains( const RenderKey& key ) const {
+    return mEntries.contains( key );
+}
+
+
+QImage PageCache::image( const RenderKey& key ) {
+    auto it = mEntries.find( key );
+
+    if ( it == mEntries.end() ) {
+        return QImage();
+    }
+
+    /* Move @key to the front of the LRU list */
+    mLru.splice( mLru.begin(), mLru, it->lruPos );
+
+    return it->image;
+}
+
+
+QImage PageCache::peek( const RenderKey& key ) const {
+    return mEntries.value( key ).image;
+}
+
+
+RenderKey PageCache::nearest( const RenderKey& key ) const {
+    RenderKey best;
+    int       bestDiff = INT_MAX;
+
+    for ( const RenderKey& other: mByPage.values( key.page ) ) {
+        if ( other.isTile() or other.preview or (other.opts != key.opts) ) {
+            continue;
         }
 
-        case QDocumentRenderOptions::Rotate90: {
-            tgtSize = QSize( mImgSize.height(), mImgSize.width() );
-            break;
+        /* Variants of a page have the same aspect: the width alone tells how close they are */
+        const int diff = qAbs( other.size.width() - key.size.width() );
+
+        if ( diff < bestDiff ) {
+            best     = other;
+            bestDiff = diff;
         }
+    }
 
-        case QDocumentRenderOptions::Rotate180: {
-            tgtSize = QSize( mImgSize.width(), mImgSize.height() );
-            break;
+    return best;
+}
+
+
+void PageCache::insert( const RenderKey& key, QImage img ) {
+    remove( key );
+
+    mLru.push_front( key );
+    mByPage.insert( key.page, key );
+
+    Entry entry;
+    entry.image  = img;
+    entry.bytes  = img.sizeInBytes();
+    entry.lruPos = mLru.begin();
+
+    mEntries.insert( key, entry );
+    mUsage += entry.bytes;
+
+    trim();
+}
+
+
+void PageCache::remove( const RenderKey& key ) {
+    auto it = mEntries.find( key );
+
+    if ( it == mEntries.end() ) {
+        return;
+    }
+
+    mUsage -= it->bytes;
+    mLru.erase( it->lruPos );
+    mByPage.remove( key.page, key );
+    mEntries.erase( it );
+}
+
+
+void PageCache::clear() {
+    mEntries.clear();
+    mLru.clear();
+    mByPage.clear();
+    mUsage = 0;
+}
+
+
+qint64 PageCache::budget() const {
+    return mBudget;
+}
+
+
+void PageCache::setBudget( qint64 bytes ) {
+    mBudget = bytes;
+    trim();
+}
+
+
+qint64 PageCache::usage() const {
+    return mUsage;
+}
+
+
+void PageCache::trim() {
+    /* Always retain the most recent entry, even if it alone exceeds the budget */
+    while ( mUsage > mBudget and mLru.size() > 1 ) {
+        remove( mLru.back() );
+    }
+}
+
+
+DiskCache::DiskCache() {
+}
+
+
+DiskCache::Shared& DiskCache::shared() {
+    static Shared instance;
+
+    return instance;
+}
+
+
+QString DiskCache::root() {
+    return QStandardPaths::writableLocation( QStandardPaths::GenericCacheLocation ) + "/qdocumentview/";
+}
+
+
+bool DiskCache::isEnabled() const {
+    return mEnabled;
+}
+
+
+void DiskCache::setEnabled( bool yes ) {
+    mEnabled = yes;
+
+    /* Fingerprint the document we already have */
+    setDocument( mDocPath );
+}
+
+
+void DiskCache::setDocument( QString docPath ) {
+    mDocPath = docPath;
+    mDocDir  = QString();
+
+    if ( mEnabled and not mDocPath.isEmpty() ) {
+        QString hash = QDocument::fingerprint( mDocPath );
+
+        if ( not hash.isEmpty() ) {
+            mDocDir = root() + hash + "/";
         }
+    }
+}
 
-        case QDocumentRenderOptions::Rotate270: {
-            tgtSize = QSize( mImgSize.height(), mImgSize.width() );
-            break;
+
+void DiskCache::reload() {
+    const QString oldDir = mDocDir;
+
+    setDocument( mDocPath );
+
+    /* The contents changed: the old images will not be used again */
+    if ( not oldDir.isEmpty() and (oldDir != mDocDir) ) {
+        QMutexLocker locker( &shared().mutex );
+
+        QDir( oldDir ).removeRecursively();
+
+        /* Rescan when needed */
+        shared().usage = -1;
+    }
+}
+
+
+QString DiskCache::path( const RenderKey& key ) const {
+    if ( mDocDir.isEmpty() ) {
+        return QString();
+    }
+
+    /* p<page>-<width>x<height>@<dpr>-<flags>-<rotation>[-t<col>-<row>].png */
+    QString name = QString( "p%1-%2x%3@%4-%5-%6" ).arg( key.page ).arg( key.size.width() ).arg( key.size.height() )
+                       .arg( key.dpr ).arg( int( key.opts.renderFlags() ) ).arg( key.opts.rotation() );
+
+    if ( key.isTile() ) {
+        name += QString( "-t%1-%2" ).arg( key.tile.x() ).arg( key.tile.y() );
+    }
+
+    return mDocDir + name + ".png";
+}
+
+
+bool DiskCache::contains( const RenderKey& key ) const {
+    const QString file = path( key );
+
+    return not file.isEmpty() and QFile::exists( file );
+}
+
+
+QImage DiskCache::load( QString path ) {
+    QImage img;
+
+    if ( path.isEmpty() or not img.load( path, "PNG" ) ) {
+        return QImage();
+    }
+
+    /* Mark it as recently used */
+    QFile file( path );
+
+    if ( file.open( QFile::ReadWrite ) ) {
+        file.setFileTime( QDateTime::currentDateTime(), QFileDevice::FileModificationTime );
+    }
+
+    return img;
+}
+
+
+void DiskCache::store( QString path, QImage img ) {
+    if ( path.isEmpty() ) {
+        return;
+    }
+
+    QDir().mkpath( QFileInfo( path ).path() );
+
+    /* Write and rename, so that other threads never read a partial file */
+    const QString tmp = path + QString( ".%1.tmp" ).arg( quintptr( QThread::currentThreadId() ) );
+
+    if ( not img.save( tmp, "PNG" ) ) {
+        QFile::remove( tmp );
+        return;
+    }
+
+    /* Swapped with the lock held: the usage counts each file once */
+    QMutexLocker locker( &shared().mutex );
+
+    /* Replacing an earlier image: its size no longer counts */
+    const qint64 oldSize = QFileInfo( path ).size();
+
+    if ( QFile::remove( path ) and (shared().usage >= 0) ) {
+        shared().usage -= oldSize;
+    }
+
+    if ( not QFile::rename( tmp, path ) ) {
+        QFile::remove( tmp );
+        return;
+    }
+
+    if ( shared().usage >= 0 ) {
+        shared().usage += QFileInfo( path ).size();
+    }
+
+    trim();
+}
+
+
+qint64 DiskCache::limit() const {
+    QMutexLocker locker( &shared().mutex );
+
+    return shared().limit;
+}
+
+
+void DiskCache::setLimit( qint64 bytes ) {
+    QMutexLocker locker( &shared().mutex );
+
+    shared().limit = bytes;
+    trim();
+}
+
+
+void DiskCache::trim() {
+    Shared& cache = shared();
+
+    /* Count what earlier sessions left behind */
+    if ( cache.usage < 0 ) {
+        cache.usage = 0;
+
+        QDirIterator it( root(), { "*.png" }, QDir::Files, QDirIterator::Subdirectories );
+
+        while ( it.hasNext() ) {
+            it.next();
+            cache.usage += it.fileInfo().size();
         }
     }
 
-    QImage img = mPage->render( tgtSize, mOpts );
+    if ( cache.usage <= cache.limit ) {
+        return;
+    }
 
-    /* Emit only if the task is valid */
-    if ( mId > 0 ) {
-        emit imageReady( mPage->pageNo(), img, mId );
+    QFileInfoList files;
+    QDirIterator  it( root(), { "*.png" }, QDir::Files, QDirIterator::Subdirectories );
+
+    while ( it.hasNext() ) {
+        it.next();
+        files << it.fileInfo();
+    }
+
+    /* Least recently used first */
+    std::sort(
+        files.begin(), files.end(), [] ( const QFileInfo& lhs, const QFileInfo& rhs ) {
+            return lhs.lastModified() < rhs.lastModified();
+        }
+    );
+
+    /* Make some room, so that we don't trim with every store */
+    for ( const QFileInfo& info: files ) {
+        if ( cache.usage <= cache.limit * 0.9 ) {
+            break;
+        }
+
+        if ( QFile::remove( info.filePath() ) ) {
+            cache.usage -= info.size();
+        }
     }
 }
 
 
 QDocumentRenderer::QDocumentRenderer( QObject *parent ) : QObject( parent ) {
-    mDoc = nullptr;
+    mDoc           = nullptr;
+    pageCache      = new PageCache( 256 * 1024 * 1024 );
+    diskCache      = new DiskCache();
+    mOwnPool       = new QThreadPool( this );
+    renderQueue    = new RenderQueue( mOwnPool );
+    mTileThreshold = 2048 * 2048;
+
+    /* Images are handed over from the pool threads: queued calls need the key registered at run time */
+    qRegisterMetaType<RenderKey>( "RenderKey" );
+}
+
+
+QDocumentRenderer::~QDocumentRenderer() {
+    renderQueue->clear();
+
+    /* Make sure none of our tasks is still rendering a page, in our pool or a shared one */
+    renderQueue->shutdown();
+
+    delete renderQueue;
+    delete pageCache;
+    delete diskCache;
 }
 
 
@@ -114,207 +706,536 @@ void QDocumentRenderer::setDocument( QDocument *doc ) {
     }
 
     /* Clear the cache */
-    pageCache.clear();
-    pages.clear();
+    pageCache->clear();
 
-    /* Clear the requests */
-    for ( int rq = 0; rq < requests.count(); rq++ ) {
-        RenderTask *task = requestCache.take( rq );
-        /* Invalidate */
-        task->invalidate();
+    cacheHits   = 0;
+    cacheMisses = 0;
 
-        /* Disconnect: Don't waste time validating it when it's complete */
-        task->disconnect();
+    /* Withdraw the pending requests */
+    renderQueue->clear();
+    mPrefetch.clear();
 
-        /* Remove @pg from @requests */
-        requests.removeAll( rq );
-    }
+    mDoc      = doc;
+    validFrom = mNextId;
 
-    /* Clear the queue */
-    for ( int q = 0; q < queue.count(); q++ ) {
-        RenderTask *task = queuedRequests.take( q );
-        /* Invalidate */
-        task->invalidate();
+    diskCache->setDocument( mDoc ? mDoc->fileNameAndPath() : QString() );
+}
 
-        /* Disconnect: Don't waste time validating it when it's complete */
-        task->disconnect();
 
-        /* Remove @pg from @requests */
-        queue.removeAll( q );
-    }
+qreal QDocumentRenderer::devicePixelRatio() const {
+    return mDevicePixelRatio;
+}
 
-    mDoc      = doc;
-    validFrom = QDateTime::currentDateTime().toSecsSinceEpoch();
+
+void QDocumentRenderer::setDevicePixelRatio( qreal dpr ) {
+    mDevicePixelRatio = (dpr > 0 ? dpr : 1.0);
 }
 
 
-QImage QDocumentRenderer::requestPage( int pg, QSize imgSz, QDocumentRenderOptions opts ) {
+QImage QDocumentRenderer::requestPage( int pg, QSize imgSz, QDocumentRenderOptions opts, RenderPriority priority ) {
     if ( pg >= mDoc->pageCount() ) {
         return QImage();
     }
 
-    /* Check if we have the image in the cache */
-    QImage img;
+    /* A whole page is identified by its number, size, render options and pixel ratio */
+    const RenderKey key( pg, imgSz, opts, mDevicePixelRatio );
+
+    /* Size of the image, in device pixels */
+    const QSize devSz = imgSz * mDevicePixelRatio;
+
+    /* Check if we have the image in the cache: this marks it as recently used */
+    QImage img = pageCache->image( key );
+
+    if ( not img.isNull() ) {
+        cacheHits++;
+        return img;
+    }
 
-    if ( pages.contains( pg ) ) {
-        /* Retrieve the image */
-        img = pageCache.value( pg );
+    cacheMisses++;
 
-        /* If the image has proper size, return it */
-        if ( img.size() == imgSz ) {
-            return img;
+    /* The closest size we have of this page: shown scaled until the page is ready */
+    const RenderKey nearKey = pageCache->nearest( key );
+
+    if ( nearKey.page != -1 ) {
+        img = pageCache->image( nearKey );
+    }
+
+    /* Check if a request has already been made: one lookup serves all the checks */
+    RenderTask *pending = renderQueue->task( key );
+
+    if ( pending != nullptr ) {
+        /* It may have been a prefetch: it's needed now */
+        renderQueue->reprioritize( key, qMax<int>( priority, pending->priority() ) );
+
+        /* Wanted as a thumbnail too: keep it when the page scrolls out of view */
+        if ( priority == ThumbnailPriority ) {
+            pending->setThumbnail( true );
         }
+
+        return scaledStandIn( img, devSz );
     }
 
-    /* Check if a request has already been made */
-    if ( requests.contains( pg ) ) {
-        /* Get the request */
-        RenderTask *request = requestCache.value( pg );
-        QSize      rq       = request->imageSize();
+    /**
+     * The zoom changed: requests for the other sizes of this variant are not needed.
+     * Other variants (rotations, flags) and thumbnails are requested independently.
+     */
+    for ( const RenderKey& other: renderQueue->keys( pg ) ) {
+        if ( other.isTile() or other.preview or (other.opts != opts) ) {
+            continue;
+        }
 
-        /* If the image has proper size, return it */
-        if ( rq == imgSz ) {
-            return (img.isNull() ? img : img.scaled( imgSz, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ) );
+        if ( renderQueue->task( other )->isThumbnail() == (priority == ThumbnailPriority) ) {
+            renderQueue->cancel( other );
+            renderQueue->cancel( other.previewKey() );
         }
+    }
 
-        /* Request is smaller. Invalidate it and remove from cache */
-        else {
-            /* Invalidate */
-            request->invalidate();
+    /**
+     * Nothing to show for this page yet: render a small preview first.
+     * Rendering a sixteenth of the pixels is much quicker on heavy pages.
+     */
+    const QSize pvSize = devSz / 4;
+
+    const bool wantPreview = mProgressivePreview and img.isNull() and (priority == VisiblePriority) and not pvSize.isEmpty();
+
+    /* Loading the page from the disk will be quick enough */
+    if ( wantPreview and not diskCache->contains( key ) ) {
+        const RenderKey pvKey = key.previewKey();
+        renderQueue->enqueue( pvKey, createTask( pvKey, pvSize, QRect(), opts ), PreviewPriority );
+    }
+
+    RenderTask *task = createTask( key, devSz, QRect(), opts );
+
+    /* Remembered apart from the priority, which setVisiblePages(...) raises for visible thumbnails */
+    task->setThumbnail( priority == ThumbnailPriority );
+
+    renderQueue->enqueue( key, task, priority );
 
-            /* Disconnect: Don't waste time validating it when it's complete */
-            request->disconnect();
+    return scaledStandIn( img, devSz );
+}
+
+
+void QDocumentRenderer::prefetchPages( QHash<int, QSize> pgs, QDocumentRenderOptions opts ) {
+    if ( mDoc == nullptr ) {
+        return;
+    }
+
+    mPrefetch = pgs;
 
-            /* Remove from cache */
-            requestCache.remove( pg );
+    /* Drop the earlier prefetches that are no longer wanted (the user jumped elsewhere) */
+    for ( const RenderKey& key: renderQueue->keys() ) {
+        RenderTask *task = renderQueue->task( key );
+
+        if ( task->priority() != PrefetchPriority ) {
+            continue;
+        }
 
-            /* Remove @pg from @requests */
-            requests.removeAll( pg );
+        if ( (key.size != pgs.value( key.page ) ) or (key.opts != opts) or (key.dpr != mDevicePixelRatio) ) {
+            renderQueue->cancel( key );
         }
     }
 
-    /* Check if a request is in the queue */
-    if ( queue.contains( pg ) ) {
-        /* Get the request */
-        RenderTask *request = queuedRequests.value( pg );
-        QSize      rq       = request->imageSize();
+    for ( auto it = pgs.cbegin(); it != pgs.cend(); ++it ) {
+        const int   pg    = it.key();
+        const QSize imgSz = it.value();
 
-        /* If the image has proper size, return it */
-        if ( rq == imgSz ) {
-            return (img.isNull() ? img : img.scaled( imgSz, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ) );
+        if ( (pg < 0) or (pg >= mDoc->pageCount() ) ) {
+            continue;
         }
 
-        /* Requested image is smaller. Remove from the queue */
-        else {
-            /* Invalidate */
-            request->invalidate();
+        /* Tiled pages are rendered only as they become visible */
+        if ( isTiled( pg, imgSz ) ) {
+            continue;
+        }
 
-            /* Disconnect: Don't waste time validating it when it's complete */
-            request->disconnect();
+        const RenderKey key( pg, imgSz, opts, mDevicePixelRatio );
 
-            /* Remove from queue */
-            queuedRequests.remove( pg );
+        /* Already rendered: peek, so that the speculation does not disturb the LRU order */
+        if ( not pageCache->peek( key ).isNull() ) {
+            continue;
+        }
 
-            /* Remove @pg from @queue */
-            queue.removeAll( pg );
+        /* Already requested */
+        if ( renderQueue->contains( key ) ) {
+            continue;
         }
+
+        renderQueue->enqueue( key, createTask( key, imgSz * mDevicePixelRatio, QRect(), opts ), PrefetchPriority );
     }
+}
 
-    RenderTask *task = new RenderTask( mDoc->page( pg ), imgSz, opts, QDateTime::currentDateTime().toSecsSinceEpoch() );
 
-    task->setAutoDelete( false );
+void QDocumentRenderer::setVisiblePages( QHash<int, QRect> pgs ) {
+    for ( const RenderKey& key: renderQueue->keys() ) {
+        RenderTask *task = renderQueue->task( key );
 
-    connect( task, &RenderTask::imageReady, this, &QDocumentRenderer::validateImage );
+        /* Previews are useful only while the page is visible */
+        if ( key.preview ) {
+            if ( not pgs.contains( key.page ) ) {
+                renderQueue->cancel( key );
+            }
+        }
 
-    /* Start rendering if there is an available slot */
-    if ( requests.count() < requestLimit ) {
-        requests << pg;
-        requestCache.insert( pg, task );
+        /* Tiles scrolled out of view will be requested again if they come back */
+        else if ( key.isTile() and pgs.contains( key.page ) ) {
+            const QRect tileRect( key.tile * tileSize(), QSize( tileSize(), tileSize() ) );
+
+            if ( tileRect.intersects( pgs.value( key.page ) ) ) {
+                renderQueue->reprioritize( key, VisiblePriority );
+            }
+
+            else {
+                renderQueue->cancel( key );
+            }
+        }
+
+        /* Visible pages come first; the overviews of tiled pages keep their higher priority */
+        else if ( pgs.contains( key.page ) ) {
+            renderQueue->reprioritize( key, qMax<int>( VisiblePriority, task->priority() ) );
+        }
+
+        /* Thumbnails are not tied to the viewport */
+        else if ( task->isThumbnail() ) {
+            continue;
+        }
 
-        /* Start the rendering in a separate thread */
-        QThreadPool::globalInstance()->start( task );
+        /* Went out of view, but is a neighbour: keep it as a prefetch */
+        else if ( not key.isTile() and (mPrefetch.value( key.page ) == key.size) ) {
+            renderQueue->reprioritize( key, PrefetchPriority );
+        }
+
+        /* No longer needed */
+        else {
+            renderQueue->cancel( key );
+        }
     }
+}
 
-    else {
-        queue << pg;
-        queuedRequests.insert( pg, task );
+
+int QDocumentRenderer::prefetchAhead() const {
+    return mPrefetchAhead;
+}
+
+
+int QDocumentRenderer::prefetchBehind() const {
+    return mPrefetchBehind;
+}
+
+
+void QDocumentRenderer::setPrefetchRange( int ahead, int behind ) {
+    mPrefetchAhead  = qMax( 0, ahead );
+    mPrefetchBehind = qMax( 0, behind );
+}
+
+
+qint64 QDocumentRenderer::tileThreshold() const {
+    return mTileThreshold;
+}
+
+
+void QDocumentRenderer::setTileThreshold( qint64 pixels ) {
+    mTileThreshold = pixels;
+}
+
+
+bool QDocumentRenderer::isTiled( int pg, QSize imgSz ) const {
+    QDocumentPage *page = (mDoc ? mDoc->page( pg ) : nullptr);
+
+    /* Each tile would be cut from a render of the whole page */
+    if ( (page == nullptr) or not page->canRenderTiles() ) {
+        return false;
     }
 
-    return (img.isNull() ? img : img.scaled( imgSz, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ) );
+    const QSize devSz = imgSz * mDevicePixelRatio;
+
+    return qint64( devSz.width() ) * devSz.height() > mTileThreshold;
+}
+
+
+int QDocumentRenderer::tileSize() const {
+    return 512;
+}
+
+
+QImage QDocumentRenderer::placeholderPage( int pg, QSize imgSz, QDocumentRenderOptions opts ) const {
+    /* Peek: the placeholder must not disturb the LRU order */
+    return pageCache->peek( pageCache->nearest( RenderKey( pg, imgSz, opts, mDevicePixelRatio ) ) );
+}
+
+
+QImage QDocumentRenderer::requestTile( int pg, QSize imgSz, QPoint tile, QDocumentRenderOptions opts ) {
+    if ( pg >= mDoc->pageCount() ) {
+        return QImage();
+    }
+
+    /* Tiles are specific to the zoom (page size) and the render options */
+    const RenderKey key( pg, imgSz, opts, mDevicePixelRatio, tile );
+
+    QImage img = pageCache->image( key );
+
+    if ( not img.isNull() ) {
+        cacheHits++;
+        return img;
+    }
+
+    cacheMisses++;
+
+    /* Something to show under the tiles that are not ready, and while zooming */
+    requestOverview( pg, imgSz, opts );
+
+    /* Already requested: wait for it */
+    if ( renderQueue->contains( key ) ) {
+        renderQueue->reprioritize( key, VisiblePriority );
+        return QImage();
+    }
+
+    /* The zoom, the options or the screen changed: the tiles requested for the old ones are not needed */
+    for ( const RenderKey& other: renderQueue->keys( pg ) ) {
+        if ( other.isTile() and ( (other.size != key.size) or (other.opts != key.opts) or (other.dpr != key.dpr) ) ) {
+            renderQueue->cancel( other );
+        }
+    }
+
+    /* Tiles at the right and bottom edges may be smaller */
+    const QRect tileRect = QRect( tile * tileSize(), QSize( tileSize(), tileSize() ) ) & QRect( QPoint( 0, 0 ), imgSz );
+
+    if ( tileRect.isEmpty() ) {
+        return QImage();
+    }
+
+    /**
+     * The tile grid is in device independent pixels. Round the edges, not the sizes,
+     * so that neighbouring tiles neither overlap nor leave a gap between them.
+     */
+    const qreal dpr    = mDevicePixelRatio;
+    const QRect device = QRect(
+        QPoint( qRound( tileRect.left() * dpr ), qRound( tileRect.top() * dpr ) ),
+        QPoint( qRound( (tileRect.right() + 1) * dpr ) - 1, qRound( (tileRect.bottom() + 1) * dpr ) - 1 )
+    );
+
+    renderQueue->enqueue( key, createTask( key, imgSz * dpr, device, opts ), VisiblePriority );
+
+    return QImage();
 }
 
 
 void QDocumentRenderer::reload() {
     /* The document was reloaded: Clear the page cache */
-    pageCache.clear();
-    pages.clear();
+    pageCache->clear();
+
+    /* Withdraw the pending requests */
+    renderQueue->clear();
 
-    /* Clear the requests */
-    for ( int rq = 0; rq < requests.count(); rq++ ) {
-        /* Get the render task */
-        RenderTask *task = requestCache.take( rq );
+    validFrom = mNextId;
 
-        /* Invalidate */
-        task->invalidate();
+    /* The images on the disk are of the old contents */
+    diskCache->reload();
+}
 
-        /* Disconnect: Don't waste time validating it when it's complete */
-        task->disconnect();
 
-        /* Remove @pg from @requests */
-        requests.removeAll( rq );
+bool QDocumentRenderer::progressivePreview() const {
+    return mProgressivePreview;
+}
+
+
+void QDocumentRenderer::setProgressivePreview( bool yes ) {
+    mProgressivePreview = yes;
+}
+
+
+QThreadPool * QDocumentRenderer::threadPool() const {
+    return renderQueue->pool();
+}
+
+
+void QDocumentRenderer::setThreadPool( QThreadPool *pool ) {
+    renderQueue->setPool( pool ? pool : mOwnPool );
+}
+
+
+int QDocumentRenderer::renderThreadCount() const {
+    return renderQueue->pool()->maxThreadCount();
+}
+
+
+void QDocumentRenderer::setRenderThreadCount( int count ) {
+    renderQueue->pool()->setMaxThreadCount( count );
+}
+
+
+QThread::Priority QDocumentRenderer::renderThreadPriority() const {
+    return mThreadPriority;
+}
+
+
+void QDocumentRenderer::setRenderThreadPriority( QThread::Priority priority ) {
+    mThreadPriority = priority;
+}
+
+
+uint QDocumentRenderer::renderThreadStackSize() const {
+    return renderQueue->pool()->stackSize();
+}
+
+
+void QDocumentRenderer::setRenderThreadStackSize( uint bytes ) {
+    renderQueue->pool()->setStackSize( bytes );
+}
+
+
+qint64 QDocumentRenderer::cacheBudget() const {
+    return pageCache->budget();
+}
+
+
+void QDocumentRenderer::setCacheBudget( qint64 bytes ) {
+    pageCache->setBudget( bytes );
+}
+
+
+qint64 QDocumentRenderer::cacheUsage() const {
+    return pageCache->usage();
+}
+
+
+qreal QDocumentRenderer::cacheHitRate() const {
+    const quint64 total = cacheHits + cacheMisses;
+
+    if ( total == 0 ) {
+        return 0.0;
+    }
+
+    return 1.0 * cacheHits / total;
+}
+
+
+bool QDocumentRenderer::diskCacheEnabled() const {
+    return diskCache->isEnabled();
+}
+
+
+void QDocumentRenderer::setDiskCacheEnabled( bool yes ) {
+    diskCache->setEnabled( yes );
+}
+
+
+qint64 QDocumentRenderer::diskCacheLimit() const {
+    return diskCache->limit();
+}
+
+
+void QDocumentRenderer::setDiskCacheLimit( qint64 bytes ) {
+    diskCache->setLimit( bytes );
+}
+
+
+void QDocumentRenderer::requestOverview( int pg, QSize imgSz, QDocumentRenderOptions opts ) {
+    const RenderKey key( pg, imgSz, opts, mDevicePixelRatio );
+
+    /* Any whole page of this variant will do, whatever its size */
+    if ( pageCache->nearest( key ).page != -1 ) {
+        return;
+    }
+
+    for ( const RenderKey& other: renderQueue->keys( pg ) ) {
+        if ( not other.isTile() and not other.preview and (other.opts == opts) ) {
+            return;
+        }
+    }
+
+    /* A quarter of the tile threshold: quick to render, and never tiled itself */
+    const QSize devSz = imgSz * mDevicePixelRatio;
+    const qreal scale = qMin( 1.0, qSqrt( (mTileThreshold / 4.0) / (qreal( devSz.width() ) * devSz.height()) ) );
+    const QSize ovSz  = (QSizeF( imgSz ) * scale).toSize();
+
+    if ( ovSz.isEmpty() ) {
+        return;
     }
 
-    /* Clear the queue */
-    for ( int q = 0; q < queue.count(); q++ ) {
-        RenderTask *task = queuedRequests.take( q );
-        /* Invalidate */
-        task->invalidate();
+    /* A whole page like any other: placeholderPage(...) finds it as the nearest image */
+    const RenderKey ovKey( pg, ovSz, opts, mDevicePixelRatio );
+
+    renderQueue->enqueue( ovKey, createTask( ovKey, ovSz * mDevicePixelRatio, QRect(), opts ), PreviewPriority );
+}
 
-        /* Disconnect: Don't waste time validating it when it's complete */
-        task->disconnect();
 
-        /* Remove @pg from @requests */
-        queue.removeAll( q );
+QImage QDocumentRenderer::scaledStandIn( QImage img, QSize devSz ) const {
+    if ( img.isNull() ) {
+        return img;
     }
 
-    validFrom = QDateTime::currentDateTime().toSecsSinceEpoch();
+    img = img.scaled( devSz, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+    img.setDevicePixelRatio( mDevicePixelRatio );
+
+    return img;
+}
+
+
+RenderTask * QDocumentRenderer::createTask( RenderKey key, QSize imgSz, QRect tile, QDocumentRenderOptions opts ) {
+    RenderTask *task = new RenderTask( mDoc->page( key.page ), key, imgSz, tile, opts, mNextId++ );
+
+    /* We delete the task when it reports back, or when we take it back from the pool */
+    task->setAutoDelete( false );
+    task->setThreadPriority( mThreadPriority );
+
+    /* Previews are quick to render, and not worth the disk space */
+    const QString cachePath = diskCache->path( key );
+
+    if ( not key.preview and not cachePath.isEmpty() ) {
+        task->setDiskCache( diskCache, cachePath );
+    }
+
+    connect( task, &RenderTask::imageReady, this, &QDocumentRenderer::validateImage );
+
+    return task;
 }
 
 
-void QDocumentRenderer::validateImage( int pg, QImage img, qint64 id ) {
-    requests.removeAll( pg );
-    requestCache.remove( pg );
+void QDocumentRenderer::validateImage( RenderKey key, QImage img, qint64 id ) {
+    RenderTask *task = qobject_cast<RenderTask *>( sender() );
+
+    /* The task has run its course */
+    renderQueue->release( task );
+    task->deleteLater();
+
+    /* Cancelled, or superseded by a newer request */
+    if ( not renderQueue->finished( key, task ) ) {
+        return;
+    }
 
     if ( id < validFrom ) {
         // The document has changed. All requests made before @validFrom will be invalidated
         return;
     }
 
-    /* Add @pg to @pages if it does not exist */
-    if ( not pages.contains( pg ) ) {
-        /* If the cache is full, remove the oldest page */
-        if ( pages.count() >= pageCacheLimit ) {
-            pageCache.remove( pages.takeFirst() );
-        }
-
-        pages.append( pg );
+    /* Rendering failed: nothing to cache */
+    if ( img.isNull() ) {
+        return;
     }
 
-    /* Add the @img corresponding to @pg */
-    pageCache.insert( pg, img );
+    if ( key.preview ) {
+        /* The page itself is ready already, or is no longer wanted */
+        if ( not renderQueue->contains( key.pageKey() ) ) {
+            return;
+        }
 
-    /* Emit the signal that the page is ready */
-    emit pageRendered( pg );
+        /* Cached at its own size, it's the nearest image until the page is ready: requestPage(...) will upscale it */
+        const QSize pvSize = (QSizeF( task->imageSize() ) / key.dpr).toSize();
 
-    /* Check if there are any outstanding tasks */
-    if ( not queue.isEmpty() ) {
-        /* Take the first page */
-        int        newPg = queue.takeFirst();
-        RenderTask *task = queuedRequests.value( newPg );
+        pageCache->insert( RenderKey( key.page, pvSize, key.opts, key.dpr ), img );
+        emit pageRendered( key.page );
 
-        requests << newPg;
-        requestCache.insert( newPg, task );
+        return;
+    }
 
-        QThreadPool::globalInstance()->start( task );
+    /* The page is ready: its preview is not needed any more */
+    if ( not key.isTile() ) {
+        renderQueue->cancel( key.previewKey() );
     }
+
+    /* Add the @img corresponding to @key: least recently used entries are dropped if we exceed the budget */
+    pageCache->insert( key, img );
+
+    /* Emit the signal that the page is ready */
+    emit pageRendered( key.page );
 }
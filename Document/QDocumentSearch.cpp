@@ -22,24 +22,42 @@
 #include <qdocumentview/QDocument.hpp>
 #include <qdocumentview/QDocumentSearch.hpp>
 
+#include <functional>
+
+/** Pages handed to a worker at a time: few enough to keep all the workers busy till the end */
+static const int ChunkSize = 8;
+
+/** Runs a search worker in the pool */
+class SearchWorker : public QRunnable {
+    public:
+        SearchWorker( std::function<void()> work ) {
+            mWork = work;
+        }
+
+        void run() override {
+            mWork();
+        }
+
+    private:
+        std::function<void()> mWork;
+};
+
 QDocumentSearch::QDocumentSearch( QObject *parent )
     : QThread( parent )
     , mDoc( nullptr )
-    , mStop( false )
-    , stop_others( false )
+    , mStop( 0 )
+    , stop_others( 0 )
     , matchCount( 0 ) {
-    connect(
-        this, &QDocumentSearch::pendingRestart, [ this ]() {
-            stop_others = false;
-            mStartPage  = pages[ 0 ];
-            start();
-        }
-    );
+    mPool = new QThreadPool( this );
+
+    /** Results are handed over to this (GUI) thread: only it touches the results, and the pending pages */
+    connect( this, &QDocumentSearch::pageSearched, this, &QDocumentSearch::acceptResults, Qt::QueuedConnection );
+    connect( this, &QDocumentSearch::runFinished,  this, &QDocumentSearch::acceptFinish,  Qt::QueuedConnection );
 }
 
 
 QDocumentSearch::~QDocumentSearch() {
-    mStop = true;
+    mStop.storeRelaxed( 1 );
     wait();
 
     matchCount = 0;
@@ -54,14 +72,23 @@ void QDocumentSearch::setDocument( QDocument *doc ) {
         return;
     }
 
-    mStop = true;
+    /** The workers use @mDoc: wait for them to give up */
+    mStop.storeRelaxed( 1 );
+    wait();
+
+    /** Results of the old document may still be queued: they will be dropped */
+    mGeneration.fetchAndAddRelaxed( 1 );
 
     matchCount = 0;
     emit matchesFound( matchCount );
 
-    needle = QString();
+    needle     = QString();
+    mStartPage = -1;
     pages.clear();
+
+    QMutexLocker locker( &mResultsLock );
     mResults.clear();
+    locker.unlock();
 
     mDoc = doc;
 }
@@ -73,7 +100,36 @@ void QDocumentSearch::setSearchString( QString str ) {
         return;
     }
 
-    mStop = true;
+    /**
+     * Abort the search in flight: the workers give up after the page at hand. We don't wait for them:
+     * the run searches its own copy of the string, and its results for the old one will be dropped.
+     */
+    mStop.storeRelaxed( 1 );
+    mGeneration.fetchAndAddRelaxed( 1 );
+
+    QMutexLocker locker( &mResultsLock );
+
+    /**
+     * Typing on: a match of the new string contains a match of the old one.
+     * Pages that did not match the old string need not be searched again.
+     */
+    QList<int> noMatch;
+
+    if ( not needle.isEmpty() and str.toLower().startsWith( needle ) ) {
+        for ( auto it = mResults.cbegin(); it != mResults.cend(); ++it ) {
+            if ( it.value().isEmpty() ) {
+                noMatch << it.key();
+            }
+        }
+    }
+
+    mResults.clear();
+
+    for ( int pg: noMatch ) {
+        mResults[ pg ] = QVector<QRectF>();
+    }
+
+    locker.unlock();
 
     mStartPage = -1;
 
@@ -82,7 +138,6 @@ void QDocumentSearch::setSearchString( QString str ) {
 
     needle = str.toLower();
     pages.clear();
-    mResults.clear();
 }
 
 
@@ -98,13 +153,27 @@ void QDocumentSearch::searchPage( int pageNo ) {
         return;
     }
 
-    /** Already searched */
-    if ( mResults.contains( pageNo ) ) {
+    /** Empty search string */
+    if ( needle.isEmpty() ) {
         return;
     }
 
-    /** Empty search string */
-    if ( needle.isEmpty() ) {
+    QMutexLocker locker( &mResultsLock );
+    const bool searched = mResults.contains( pageNo );
+    const bool complete = (mResults.count() == mDoc->pageCount() );
+    locker.unlock();
+
+    /** The run in flight is for an older string: it is giving up, and a new one will follow */
+    const bool stale = (mRunGeneration != mGeneration.loadRelaxed() );
+
+    /** Already searched, or known not to match: the other pages may still need searching */
+    if ( searched and isRunning() and not stale ) {
+        return;
+    }
+
+    /** No page can match: nothing to search */
+    if ( searched and complete ) {
+        emit searchComplete( matchCount );
         return;
     }
 
@@ -113,136 +182,225 @@ void QDocumentSearch::searchPage( int pageNo ) {
     }
 
     /** Add to the list */
-    pages.push( pageNo );
-
-    mStop = false;
+    if ( not searched ) {
+        pages.push( pageNo );
+    }
 
+    /** The search in flight will hand over what it has (or give up), and we'll begin again from @pageNo */
     if ( isRunning() ) {
-        stop_others = true;
+        stop_others.storeRelaxed( 1 );
+        return;
     }
 
-    if ( not isRunning() ) {
-        mStop       = false;
-        stop_others = false;
-        start();
-    }
+    startRun();
 }
 
 
 QVector<QRectF> QDocumentSearch::results( int pageNo ) {
+    QMutexLocker locker( &mResultsLock );
+
     return mResults.value( pageNo );
 }
 
 
 void QDocumentSearch::stop() {
-    mStop = true;
+    mStop.storeRelaxed( 1 );
 }
 
 
-void QDocumentSearch::run() {
-    /** Pages requested by the user */
-    while ( pages.count() ) {
-        if ( mStop ) {
-            return;
-        }
+int QDocumentSearch::searchThreadCount() const {
+    return mPool->maxThreadCount();
+}
 
-        int curPage = pages.pop();
 
-        QList<QRectF> _results = mDoc->search( needle, curPage, QDocumentRenderOptions() );
-        matchCount += _results.length();
+void QDocumentSearch::setSearchThreadCount( int count ) {
+    mPool->setMaxThreadCount( qMax( 1, count ) );
+}
 
-        /** Emit signal only if new search results were obtained */
-        if ( _results.length() ) {
-            emit matchesFound( matchCount );
-        }
 
-        mResults[ curPage ] = QVector<QRectF>::fromList( _results );
+void QDocumentSearch::startRun() {
+    QMutexLocker locker( &mResultsLock );
 
-        /** If we've stopped, then we don't want any signals being emitted */
-        if ( not mStop ) {
-            /** Emit signal only if new search results were obtained */
-            if ( _results.length() ) {
-                emit resultsReady( curPage, mResults[ curPage ] );
-            }
+    /** Reading order: the pages requested by the user (latest first), the pages after the start page, and those before it */
+    mOrder.clear();
+
+    while ( pages.count() ) {
+        int curPage = pages.pop();
+
+        if ( not mResults.contains( curPage ) and not mOrder.contains( curPage ) ) {
+            mOrder << curPage;
         }
     }
 
-    /** Search all the subsequent pages */
     for ( int pg = mStartPage + 1; pg < mDoc->pageCount(); pg++ ) {
-        if ( mStop ) {
-            return;
+        if ( not mResults.contains( pg ) ) {
+            mOrder << pg;
         }
+    }
 
-        if ( stop_others ) {
-            emit pendingRestart();
-            return;
+    for ( int pg = 0; pg < mStartPage; pg++ ) {
+        if ( not mResults.contains( pg ) ) {
+            mOrder << pg;
         }
+    }
 
-        /** Already finished with @pg */
-        if ( mResults.contains( pg ) ) {
-            continue;
-        }
+    locker.unlock();
 
-        QList<QRectF> _results = mDoc->search( needle, pg, QDocumentRenderOptions() );
+    /** Whatever is still queued from the earlier runs is dropped: those pages are in @mOrder again */
+    mRunGeneration = mGeneration.fetchAndAddRelaxed( 1 ) + 1;
+    mRunNeedle     = needle;
+    mRunDoc        = mDoc;
 
-        matchCount += _results.count();
+    mStop.storeRelaxed( 0 );
+    stop_others.storeRelaxed( 0 );
 
-        /** Emit signal only if new search results were obtained */
-        if ( _results.length() ) {
-            emit matchesFound( matchCount );
-        }
+    /** @mOrder and the run's copies are not touched till the run is over: start() publishes them to the thread */
+    start();
+}
 
-        mResults[ pg ] = QVector<QRectF>::fromList( _results );
 
-        /** If we've stopped, then we don't want any signals being emitted */
-        if ( not mStop ) {
-            /** Emit signal only if new search results were obtained */
-            if ( _results.length() ) {
-                emit resultsReady( pg, mResults[ pg ] );
-            }
-        }
+void QDocumentSearch::acceptResults( quint64 generation, int pageNo, QVector<QRectF> _results ) {
+    /** From an earlier run, string or document */
+    if ( generation != mGeneration.loadRelaxed() ) {
+        return;
     }
 
-    /** Search all the pages from the beginning till the starting page */
-    for ( int pg = 0; pg < mStartPage; pg++ ) {
-        if ( mStop ) {
-            return;
-        }
+    matchCount += _results.length();
 
-        if ( stop_others ) {
-            emit pendingRestart();
-            return;
-        }
+    /** Emit signal only if new search results were obtained */
+    if ( _results.length() ) {
+        emit matchesFound( matchCount );
+    }
 
-        /** Already finished with @pg */
-        if ( mResults.contains( pg ) ) {
-            continue;
-        }
+    QMutexLocker locker( &mResultsLock );
+    mResults[ pageNo ] = _results;
 
-        QList<QRectF> _results = mDoc->search( needle, pg, QDocumentRenderOptions() );
+    const bool complete = (mResults.count() == mDoc->pageCount() );
+    locker.unlock();
 
-        matchCount += _results.count();
+    /** Emit signal only if new search results were obtained */
+    if ( _results.length() ) {
+        emit resultsReady( pageNo, _results );
+    }
 
-        /** Emit signal only if new search results were obtained */
-        if ( _results.length() ) {
-            emit matchesFound( matchCount );
-        }
+    /** The last page is in: the thread may still be winding down */
+    if ( complete ) {
+        emit searchComplete( matchCount );
+        mStartPage = -1;
+    }
+}
+
+
+void QDocumentSearch::acceptFinish( quint64 generation ) {
+    /** A newer run has started already: it will report for itself */
+    if ( generation != mRunGeneration ) {
+        return;
+    }
+
+    /** run(...) has returned, or is about to */
+    wait();
+
+    /** A page was requested meanwhile: search again, starting from that page */
+    if ( not pages.isEmpty() ) {
+        mStartPage = pages.top();
+        startRun();
+    }
+
+    /** The string changed while the run was giving up, and pages of the new one were asked for */
+    else if ( (generation != mGeneration.loadRelaxed() ) and (mStartPage != -1) ) {
+        startRun();
+    }
+}
 
-        mResults[ pg ] = QVector<QRectF>::fromList( _results );
 
-        /** If we've stopped, then we don't want any signals being emitted */
-        if ( not mStop ) {
-            /** Emit signal only if new search results were obtained */
-            if ( _results.length() ) {
-                emit resultsReady( pg, mResults[ pg ] );
+void QDocumentSearch::run() {
+    /** Our own copies: the GUI thread moves on to a new string without waiting for us */
+    const quint64      generation = mRunGeneration;
+    const QVector<int> order      = mOrder;
+    const QString      query      = mRunNeedle;
+    QDocument          *doc       = mRunDoc;
+
+    /** Filled in by the workers: each slot is written by exactly one worker */
+    QVector<QList<QRectF> > found( order.count() );
+    QVector<bool>           done( order.count(), false );
+
+    QMutex         lock;
+    QWaitCondition ready;
+    QAtomicInt     nextPage( 0 );
+
+    const int chunks  = (order.count() + ChunkSize - 1) / ChunkSize;
+    int       running = qMin( mPool->maxThreadCount(), chunks );
+
+    /** Stop completely, or make way for a page the user wants now */
+    auto interrupted = [ this ] () {
+        return mStop.loadRelaxed() or stop_others.loadRelaxed();
+    };
+
+    auto work = [ & ] () {
+        /** Take the next chunk, until none are left, or until we're interrupted */
+        while ( not interrupted() ) {
+            const int first = nextPage.fetchAndAddRelaxed( ChunkSize );
+
+            if ( first >= order.count() ) {
+                break;
+            }
+
+            const int last = qMin( first + ChunkSize, (int)order.count() );
+
+            for ( int i = first; i < last; i++ ) {
+                /** The unsearched pages will be taken up when the search restarts */
+                if ( interrupted() ) {
+                    break;
+                }
+
+                QList<QRectF> _results = doc->search( query, order[ i ], QDocumentRenderOptions() );
+
+                QMutexLocker locker( &lock );
+                found[ i ] = _results;
+                done[ i ]  = true;
+                ready.wakeAll();
             }
         }
+
+        QMutexLocker locker( &lock );
+        running--;
+        ready.wakeAll();
+    };
+
+    /** @work refers to the locals of this function: we wait below till all the workers are done */
+    for ( int w = running; w > 0; w-- ) {
+        mPool->start( new SearchWorker( work ) );
     }
 
-    /** We've reached here ==> Search of all pages must be complete. */
-    if ( mResults.keys().count() == mDoc->pageCount() ) {
-        emit searchComplete( matchCount );
+    /** Hand the results over in the reading order, as soon as the pages before them are done */
+    int next = 0;
+
+    QMutexLocker locker( &lock );
+
+    while ( true ) {
+        while ( not mStop.loadRelaxed() and (next < order.count() ) and done[ next ] ) {
+            emit pageSearched( generation, order[ next ], QVector<QRectF>::fromList( found[ next ] ) );
+            next++;
+        }
+
+        if ( running == 0 ) {
+            break;
+        }
+
+        ready.wait( &lock );
     }
 
-    mStartPage = -1;
+    locker.unlock();
+
+    /** Interrupted for a page the user wants now: keep the pages that were done out of order */
+    if ( not mStop.loadRelaxed() ) {
+        for ( int i = next; i < order.count(); i++ ) {
+            if ( done[ i ] ) {
+                emit pageSearched( generation, order[ i ], QVector<QRectF>::fromList( found[ i ] ) );
+            }
+        }
+    }
+
+    /** Even when stopped: a run for the new search string may be waiting for us to finish */
+    emit runFinished( generation );
 }
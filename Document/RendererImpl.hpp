@@ -24,17 +24,113 @@
 #include <qdocumentview/QDocumentRenderer.hpp>
 #include <qdocumentview/QDocumentRenderOptions.hpp>
 
+#include <list>
+
 class QDocumentPage;
+class DiskCache;
+class RenderQueue;
+
+/**
+ * Identifies an image produced by the renderer.
+ * A whole page is identified by its number, its @size and the render options:
+ * several variants of a page (sizes, rotations, flags) may coexist. A tile is
+ * a fixed-size square cut from a page rendered at @size (the zoom bucket), with
+ * @tile holding its column and row. A @preview is the quick, low resolution
+ * render of a whole page shown until the page is ready.
+ * @size is in device independent pixels: the image itself has @dpr times as
+ * many pixels along each side, so that it is sharp on high-DPI screens.
+ */
+struct RenderKey {
+    RenderKey( int pg = -1, QSize sz = QSize(), QDocumentRenderOptions o = QDocumentRenderOptions(), qreal r = 1.0, QPoint t = QPoint( -1, -1 ), bool pv = false ) {
+        page    = pg;
+        size    = sz;
+        opts    = o;
+        dpr     = r;
+        tile    = t;
+        preview = pv;
+    }
+
+    /* Key of the preview of this page */
+    RenderKey previewKey() const {
+        return RenderKey( page, size, opts, dpr, QPoint( -1, -1 ), true );
+    }
+
+    /* Key of the page of which this is the preview */
+    RenderKey pageKey() const {
+        return RenderKey( page, size, opts, dpr );
+    }
+
+    bool isTile() const {
+        return tile.x() >= 0 and tile.y() >= 0;
+    }
+
+    int                    page;
+    QSize                  size;
+    QDocumentRenderOptions opts;
+    qreal                  dpr;
+    QPoint                 tile;
+    bool                   preview;
+};
+
+inline bool operator==( const RenderKey& lhs, const RenderKey& rhs ) {
+    return lhs.page == rhs.page and lhs.size == rhs.size and lhs.opts == rhs.opts and lhs.dpr == rhs.dpr
+           and lhs.tile == rhs.tile and lhs.preview == rhs.preview;
+}
+
+
+#if QT_VERSION < QT_VERSION_CHECK( 6, 0, 0 )
+inline uint qHash( const RenderKey& key, uint seed = 0 ) {
+#else
+inline size_t qHash( const RenderKey& key, size_t seed = 0 ) {
+#endif
+    /**
+     * Chain the fields, rather than xor their hashes: xor cancels equal terms,
+     * and the tiles of a page would crowd a handful of buckets.
+     */
+    const int fields[] = {
+        key.page, key.size.width(), key.size.height(), key.tile.x(), key.tile.y(), int( key.preview )
+    };
+
+    seed = qHash( key.opts, seed );
+    seed = qHash( key.dpr, seed );
+
+    for ( int field: fields ) {
+        seed ^= qHash( field ) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    return seed;
+}
+
+
+Q_DECLARE_METATYPE( RenderKey );
 
 class RenderTask : public QObject, public QRunnable {
     Q_OBJECT;
 
     public:
-        RenderTask( QDocumentPage *pg, QSize imgSz, QDocumentRenderOptions opts, qint64 id );
+        RenderTask( QDocumentPage *pg, RenderKey key, QSize imgSz, QRect tile, QDocumentRenderOptions opts, qint64 id );
 
         int pageNumber();
         qint64 requestId();
         QSize imageSize();
+        RenderKey key();
+
+        /* Priority with which this task was submitted to the thread pool; it only orders the tasks */
+        int priority();
+        void setPriority( int );
+
+        /* Requested as a thumbnail: not tied to the viewport, whatever its priority */
+        bool isThumbnail();
+        void setThumbnail( bool );
+
+        /* Priority of the thread running this task */
+        void setThreadPriority( QThread::Priority );
+
+        /* Look for the image in @cache at @path before rendering, and store it there after */
+        void setDiskCache( DiskCache *cache, QString path );
+
+        /* Queue to notify when the task is done running */
+        void setQueue( RenderQueue *queue );
 
         void invalidate();
 
@@ -42,10 +138,205 @@ class RenderTask : public QObject, public QRunnable {
 
     private:
         QDocumentPage *mPage;
+        RenderKey mKey;
         QSize mImgSize;
+        QRect mTile;
         QDocumentRenderOptions mOpts;
-        qint64 mId;
+        int mPriority;
+        bool mThumbnail = false;
+        QThread::Priority mThreadPriority;
+
+        DiskCache *mDiskCache = nullptr;
+        QString mCachePath;
+
+        RenderQueue *mQueue = nullptr;
+
+        /* Written by the GUI thread, read by the worker */
+        QAtomicInteger<qint64> mId;
 
     Q_SIGNALS:
-        void imageReady( int pageNo, QImage image, qint64 id );
+        /* Emitted even if the task was invalidated, so that it can be disposed of */
+        void imageReady( RenderKey key, QImage image, qint64 id );
+};
+
+/**
+ * Pending render requests. All of them are handed to the thread pool with
+ * their priority, which decides the order in which they are rendered.
+ * Requests that have not started yet can be re-prioritized or withdrawn.
+ */
+class RenderQueue {
+    public:
+        RenderQueue( QThreadPool *pool );
+
+        /* Thread pool in which the requests are rendered */
+        QThreadPool * pool() const;
+
+        /* Move the requests that have not started yet to @pool */
+        void setPool( QThreadPool *pool );
+
+        /* Check if @key is being rendered or waiting to be rendered */
+        bool contains( const RenderKey& key ) const;
+        RenderTask * task( const RenderKey& key ) const;
+
+        /* All the pending requests */
+        QList<RenderKey> keys() const;
+
+        /* Pending requests of page @pg: its variants, tiles and previews */
+        QList<RenderKey> keys( int pg ) const;
+
+        /* Submit @task to the thread pool with the given @priority */
+        void enqueue( const RenderKey& key, RenderTask *task, int priority );
+
+        /* Change the priority of @key if it has not started yet */
+        void reprioritize( const RenderKey& key, int priority );
+
+        /* Withdraw the request for @key; if it's already running, its result will be ignored */
+        void cancel( const RenderKey& key );
+
+        /* @task reported back: returns true if it is the current request for @key */
+        bool finished( const RenderKey& key, RenderTask *task );
+
+        /* Cancel all the requests */
+        void clear();
+
+        /* @task reported back: the renderer disposes of it from now on */
+        void release( RenderTask *task );
+
+        /* Called by a task, from its thread, as the last thing it does */
+        void taskDone();
+
+        /**
+         * Wait till none of our tasks is running, or waiting in a pool, whichever pool it is;
+         * then delete the tasks that will never report back. Call after clear().
+         */
+        void shutdown();
+
+    private:
+        QThreadPool *mPool;
+
+        /* Tasks we created that are yet to report back; GUI thread only */
+        QSet<RenderTask *> mLive;
+
+        /* Tasks handed to a pool that have not finished running */
+        int mOutstanding = 0;
+        QMutex mRunLock;
+        QWaitCondition mRunDone;
+
+        QHash<RenderKey, RenderTask *> pending;
+
+        /* Keys of @pending, by page */
+        QMultiHash<int, RenderKey> byPage;
+};
+
+/**
+ * LRU cache of rendered pages and tiles, bounded by the memory used by the images.
+ * Every lookup moves the entry to the front; when the budget is exceeded,
+ * the least recently used entries are dropped from the back.
+ */
+class PageCache {
+    public:
+        PageCache( qint64 budget );
+
+        bool contains( const RenderKey& key ) const;
+
+        /* Retrieve the image of @key, and mark it as the most recently used */
+        QImage image( const RenderKey& key );
+
+        /* Retrieve the image of @key without changing its position */
+        QImage peek( const RenderKey& key ) const;
+
+        /**
+         * The cached whole page closest in size to @key, with the same options.
+         * Returns an invalid key (page -1) if there is none.
+         */
+        RenderKey nearest( const RenderKey& key ) const;
+
+        void insert( const RenderKey& key, QImage img );
+        void remove( const RenderKey& key );
+        void clear();
+
+        qint64 budget() const;
+        void setBudget( qint64 bytes );
+
+        qint64 usage() const;
+
+    private:
+        struct Entry {
+            QImage                         image;
+            qint64                         bytes;
+            std::list<RenderKey>::iterator lruPos;
+        };
+
+        /* Drop the least recently used entries till we're within the budget */
+        void trim();
+
+        QHash<RenderKey, Entry> mEntries;
+
+        /* Most recently used entry at the front */
+        std::list<RenderKey> mLru;
+
+        /* Keys of @mEntries, by page */
+        QMultiHash<int, RenderKey> mByPage;
+
+        qint64 mBudget;
+        qint64 mUsage = 0;
+};
+
+/**
+ * Second level cache of rendered images, as PNG files under $XDG_CACHE_HOME/qdocumentview.
+ * The images of a document live in a directory named after a fingerprint of its contents,
+ * so they are found again when the same file is opened in a later session. The files
+ * are touched when read; beyond the size limit, the least recently used are removed.
+ * Each renderer has its own DiskCache for its document, but the directory, the limit and
+ * the usage are shared by all of them in the process.
+ * load(...) and store(...) are called from the render threads.
+ */
+class DiskCache {
+    public:
+        DiskCache();
+
+        bool isEnabled() const;
+        void setEnabled( bool );
+
+        /* Fingerprint the document at @docPath; an empty path forgets the document */
+        void setDocument( QString docPath );
+
+        /* The document changed on disk: drop its images if its contents changed */
+        void reload();
+
+        /* File in which the image of @key is stored; empty if disabled */
+        QString path( const RenderKey& key ) const;
+
+        bool contains( const RenderKey& key ) const;
+
+        QImage load( QString path );
+        void store( QString path, QImage img );
+
+        qint64 limit() const;
+        void setLimit( qint64 bytes );
+
+    private:
+        /* Accounting of the cache directory, common to all the renderers */
+        struct Shared {
+            QMutex mutex;
+
+            /* 1 GiB by default */
+            qint64 limit = 1024 * 1024 * 1024;
+
+            /* Bytes used on the disk; -1 till the cache directory is scanned */
+            qint64 usage = -1;
+        };
+
+        static Shared& shared();
+
+        /* Remove the least recently used files till we're within the limit; call with the shared mutex held */
+        static void trim();
+
+        /* The cache directory */
+        static QString root();
+
+        bool mEnabled = false;
+
+        QString mDocPath;
+        QString mDocDir;
 };
@@ -0,0 +1,387 @@
+/**
+ * This file is a part of QDocumentView Project.
+ * QDocumentView is a widget to render multi-page documents
+ * Copyright 2021-2022 Britanicus <marcusbritanicus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * at your option, any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ **/
+
+#include "TextIndex.hpp"
+
+#include <cstring>
+
+/**
+ * Layout of an index file, in the byte order of this machine (it's a local cache):
+ * the header, a PageEntry per page, and the pages themselves, each 16-byte aligned:
+ * the boxes of the characters, followed by the folded text in UTF-16.
+ */
+struct FileHeader {
+    char    magic[ 8 ];
+    quint32 version;
+    quint32 pageCount;
+};
+
+struct PageEntry {
+    quint64 offset;
+    quint32 length;
+    quint32 reserved;
+};
+
+static const char IndexMagic[ 8 ] = { 'Q', 'D', 'V', 'I', 'N', 'D', 'E', 'X' };
+static const quint32 IndexVersion = 1;
+
+/** Bytes taken by a page of @length characters */
+static qint64 pageBytes( qint64 length ) {
+    return length * (qint64)(sizeof( TextIndex::Glyph ) + sizeof( QChar ) );
+}
+
+
+/** Fold a single character: decomposition may yield more than one (ligatures, for example) */
+static QString foldChar( QChar ch ) {
+    /** Plain ASCII: the bulk of most documents */
+    if ( ch.unicode() < 0x80 ) {
+        return QString( ch.toLower() );
+    }
+
+    QString folded;
+
+    for ( QChar part: QString( ch ).normalized( QString::NormalizationForm_KD ) ) {
+        if ( part.isMark() ) {
+            continue;
+        }
+
+        folded += part.toLower();
+    }
+
+    return folded;
+}
+
+
+/** Append the rects of the occurrences of @needle in @text to @rects */
+static void findAll( const QString& text, const TextIndex::Glyph *glyphs, const QString& needle, QList<QRectF>& rects ) {
+    for ( int pos = text.indexOf( needle ); pos != -1; pos = text.indexOf( needle, pos + 1 ) ) {
+        QRectF rect;
+
+        for ( int i = pos; i < pos + needle.length(); i++ ) {
+            const TextIndex::Glyph& glyph = glyphs[ i ];
+
+            /** Spaces and line breaks have no box */
+            if ( glyph.right <= glyph.left ) {
+                continue;
+            }
+
+            rect |= QRectF( QPointF( glyph.left, glyph.top ), QPointF( glyph.right, glyph.bottom ) );
+        }
+
+        rects << rect;
+    }
+}
+
+
+/** Check that the file is an index of @pageCount pages, and that none of them runs past its end */
+static bool isValidFile( const uchar *map, qint64 size, int pageCount ) {
+    const qint64 tableEnd = sizeof( FileHeader ) + qint64( pageCount ) * sizeof( PageEntry );
+
+    if ( size < tableEnd ) {
+        return false;
+    }
+
+    const FileHeader *header = reinterpret_cast<const FileHeader *>( map );
+
+    if ( memcmp( header->magic, IndexMagic, sizeof( IndexMagic ) ) or (header->version != IndexVersion) ) {
+        return false;
+    }
+
+    if ( header->pageCount != quint32( pageCount ) ) {
+        return false;
+    }
+
+    const PageEntry *entries = reinterpret_cast<const PageEntry *>( map + sizeof( FileHeader ) );
+
+    for ( int pg = 0; pg < pageCount; pg++ ) {
+        const PageEntry& entry = entries[ pg ];
+
+        if ( (entry.offset % 16) or (qint64( entry.offset ) < tableEnd) ) {
+            return false;
+        }
+
+        if ( qint64( entry.offset ) + pageBytes( entry.length ) > size ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+TextIndex::~TextIndex() {
+    close();
+}
+
+
+void TextIndex::setDocument( QString hash, int pageCount ) {
+    QWriteLocker locker( &mLock );
+
+    /* Same contents: keep what we have */
+    if ( (hash == mHash) and (pageCount == mPageCount) ) {
+        return;
+    }
+
+    const QString oldFile = filePath();
+
+    close();
+    mPages.clear();
+
+    /* The contents changed: the old file will not be used again */
+    if ( not oldFile.isEmpty() ) {
+        QFile::remove( oldFile );
+    }
+
+    mHash      = hash;
+    mPageCount = pageCount;
+
+    open();
+}
+
+
+void TextIndex::setDirectory( QString dir ) {
+    QWriteLocker locker( &mLock );
+
+    if ( mDir == dir ) {
+        return;
+    }
+
+    close();
+
+    mDir = dir;
+
+    if ( not mDir.isEmpty() ) {
+        QDir().mkpath( mDir );
+    }
+
+    open();
+
+    /* Indexed completely before we had a directory */
+    if ( (mMap == nullptr) and mPageCount and (mPages.count() == mPageCount) ) {
+        save();
+    }
+}
+
+
+bool TextIndex::contains( int pageNo ) const {
+    QReadLocker locker( &mLock );
+
+    /* The file has all the pages */
+    if ( mMap ) {
+        return (pageNo >= 0) and (pageNo < mPageCount);
+    }
+
+    return mPages.contains( pageNo );
+}
+
+
+void TextIndex::insert( int pageNo, const QDocumentPageText& pageText ) {
+    Page page;
+
+    page.text.reserve( pageText.text.length() );
+    page.glyphs.reserve( pageText.text.length() );
+
+    for ( int i = 0; i < pageText.text.length(); i++ ) {
+        const QRectF box   = pageText.boxes.value( i );
+        const Glyph  glyph = { float( box.left() ), float( box.top() ), float( box.right() ), float( box.bottom() ) };
+
+        /** Every folded character keeps the box of the character it came from */
+        for ( QChar ch: foldChar( pageText.text.at( i ) ) ) {
+            page.text += ch;
+            page.glyphs << glyph;
+        }
+    }
+
+    QWriteLocker locker( &mLock );
+
+    /* Already in the file */
+    if ( mMap ) {
+        return;
+    }
+
+    mPages.insert( pageNo, page );
+
+    /* That was the last page: keep the index for later sessions */
+    if ( mPages.count() == mPageCount ) {
+        save();
+    }
+}
+
+
+QList<QRectF> TextIndex::search( int pageNo, QString query ) const {
+    const QString needle = fold( query );
+
+    QList<QRectF> rects;
+
+    if ( needle.isEmpty() ) {
+        return rects;
+    }
+
+    QReadLocker locker( &mLock );
+
+    /* Read straight from the mapping: the text is not copied */
+    QString      text;
+    const Glyph *glyphs = nullptr;
+
+    if ( mappedPage( pageNo, text, glyphs ) ) {
+        findAll( text, glyphs, needle, rects );
+        return rects;
+    }
+
+    auto it = mPages.constFind( pageNo );
+
+    if ( it != mPages.constEnd() ) {
+        findAll( it->text, it->glyphs.constData(), needle, rects );
+    }
+
+    return rects;
+}
+
+
+QString TextIndex::fold( QString str ) {
+    QString folded;
+
+    folded.reserve( str.length() );
+
+    for ( QChar ch: str ) {
+        folded += foldChar( ch );
+    }
+
+    return folded;
+}
+
+
+bool TextIndex::mappedPage( int pageNo, QString& text, const Glyph *& glyphs ) const {
+    if ( (mMap == nullptr) or (pageNo < 0) or (pageNo >= mPageCount) ) {
+        return false;
+    }
+
+    const PageEntry& entry = reinterpret_cast<const PageEntry *>( mMap + sizeof( FileHeader ) )[ pageNo ];
+
+    glyphs = reinterpret_cast<const Glyph *>( mMap + entry.offset );
+    text   = QString::fromRawData( reinterpret_cast<const QChar *>( mMap + entry.offset + entry.length * sizeof( Glyph ) ), entry.length );
+
+    return true;
+}
+
+
+QString TextIndex::filePath() const {
+    if ( mDir.isEmpty() or mHash.isEmpty() ) {
+        return QString();
+    }
+
+    return mDir + "/" + mHash + ".idx";
+}
+
+
+void TextIndex::open() {
+    const QString path = filePath();
+
+    if ( path.isEmpty() or mMap ) {
+        return;
+    }
+
+    mFile.setFileName( path );
+
+    if ( not mFile.open( QFile::ReadOnly ) ) {
+        return;
+    }
+
+    /* Nothing is read yet: the pages are brought in as they are searched */
+    const uchar *map = mFile.map( 0, mFile.size() );
+
+    if ( (map == nullptr) or not isValidFile( map, mFile.size(), mPageCount ) ) {
+        /* Closing the file unmaps it */
+        mFile.close();
+        return;
+    }
+
+    mMap = map;
+
+    /* All of it is in the file */
+    mPages.clear();
+}
+
+
+void TextIndex::close() {
+    if ( mMap ) {
+        mFile.unmap( const_cast<uchar *>( mMap ) );
+        mMap = nullptr;
+    }
+
+    mFile.close();
+}
+
+
+void TextIndex::save() {
+    const QString path = filePath();
+
+    if ( path.isEmpty() ) {
+        return;
+    }
+
+    /* Written to a temporary file and renamed: a partial file is never mapped */
+    QSaveFile file( path );
+
+    if ( not file.open( QFile::WriteOnly ) ) {
+        return;
+    }
+
+    FileHeader header;
+
+    memcpy( header.magic, IndexMagic, sizeof( IndexMagic ) );
+    header.version   = IndexVersion;
+    header.pageCount = quint32( mPageCount );
+
+    /* Offsets of the pages: each is aligned to 16 bytes */
+    QVector<PageEntry> entries( mPageCount );
+    qint64 offset = sizeof( FileHeader ) + qint64( mPageCount ) * sizeof( PageEntry );
+
+    for ( int pg = 0; pg < mPageCount; pg++ ) {
+        offset = (offset + 15) & ~qint64( 15 );
+
+        entries[ pg ].offset   = quint64( offset );
+        entries[ pg ].length   = quint32( mPages.value( pg ).text.length() );
+        entries[ pg ].reserved = 0;
+
+        offset += pageBytes( entries[ pg ].length );
+    }
+
+    file.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+    file.write( reinterpret_cast<const char *>( entries.constData() ), entries.count() * sizeof( PageEntry ) );
+
+    for ( int pg = 0; pg < mPageCount; pg++ ) {
+        const Page page = mPages.value( pg );
+
+        /* Pad up to the offset of this page */
+        file.write( QByteArray( int( entries[ pg ].offset - file.pos() ), '\0' ) );
+
+        file.write( reinterpret_cast<const char *>( page.glyphs.constData() ), page.glyphs.count() * sizeof( Glyph ) );
+        file.write( reinterpret_cast<const char *>( page.text.constData() ), page.text.length() * sizeof( QChar ) );
+    }
+
+    if ( not file.commit() ) {
+        return;
+    }
+
+    /* Search from the mapping: the pages in memory are not needed any more */
+    open();
+}
@@ -0,0 +1,103 @@
+/**
+ * This file is a part of QDocumentView Project.
+ * QDocumentView is a widget to render multi-page documents
+ * Copyright 2021-2022 Britanicus <marcusbritanicus@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * at your option, any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ **/
+
+#pragma once
+
+#include <QtCore>
+
+#include <qdocumentview/QDocument.hpp>
+
+/**
+ * The text of the pages of a document, kept in memory for searching.
+ * The text is stored case and diacritic folded, the way Poppler compares
+ * it, with the box of each character: a match is a plain substring lookup,
+ * and its rect is the union of the boxes of its characters.
+ * Pages are indexed and searched from several threads at once.
+ *
+ * Given a directory, the complete index is also written to a file named after
+ * the fingerprint of the document. The file is memory-mapped when the same
+ * contents are opened again: pages are then read straight from the mapping.
+ */
+class TextIndex {
+    public:
+        /* Box of a character, in points: floats, to keep the index small */
+        struct Glyph {
+            float left;
+            float top;
+            float right;
+            float bottom;
+        };
+
+        ~TextIndex();
+
+        /**
+         * The document was (re)loaded: @hash is its fingerprint. The index is kept
+         * if the contents did not change; otherwise it's dropped, with its file.
+         */
+        void setDocument( QString hash, int pageCount );
+
+        /* Directory in which the index files are kept; empty to keep the index only in memory */
+        void setDirectory( QString dir );
+
+        /* Check if @pageNo has been indexed */
+        bool contains( int pageNo ) const;
+
+        /* Index the text of @pageNo; the file is written once all the pages are indexed */
+        void insert( int pageNo, const QDocumentPageText& pageText );
+
+        /* Rects of the occurrences of @query in @pageNo */
+        QList<QRectF> search( int pageNo, QString query ) const;
+
+        /* Lower case, without diacritics: the form in which the text is stored */
+        static QString fold( QString str );
+
+    private:
+        struct Page {
+            QString         text;
+            QVector<Glyph> glyphs;
+        };
+
+        /* Page @pageNo in the mapped file: false if it is not there */
+        bool mappedPage( int pageNo, QString& text, const Glyph *& glyphs ) const;
+
+        /* File of the current document; empty if there is none */
+        QString filePath() const;
+
+        /* Map the file of the current document, if there is a valid one; call with @mLock held for writing */
+        void open();
+
+        /* Unmap the file; call with @mLock held for writing */
+        void close();
+
+        /* Write the pages to the file, and map it instead; call with @mLock held for writing */
+        void save();
+
+        QHash<int, Page> mPages;
+
+        QString mHash;
+        QString mDir;
+        int mPageCount = 0;
+
+        QFile mFile;
+        const uchar *mMap = nullptr;
+
+        mutable QReadWriteLock mLock;
+};
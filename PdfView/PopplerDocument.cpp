@@ -26,6 +26,12 @@ PopplerDocument::PopplerDocument( QString pdfPath ) : QDocument( pdfPath ) {
 }
 
 
+PopplerDocument::~PopplerDocument() {
+    /* Before mPdfDoc goes: the size reader may still be querying our pages */
+    resetPageSizes();
+}
+
+
 void PopplerDocument::setPassword( QString password ) {
     if ( mPdfDoc->unlock( password.toLatin1(), password.toLatin1() ) ) {
         mStatus = Failed;
@@ -49,19 +55,7 @@ void PopplerDocument::setPassword( QString password ) {
     mPdfDoc->setRenderHint( Poppler::Document::TextAntialiasing );
     mPdfDoc->setRenderHint( Poppler::Document::TextHinting );
 
-    for ( int i = 0; i < mPdfDoc->numPages(); i++ ) {
-#if QT_VERSION < QT_VERSION_CHECK( 6, 0, 0 )
-        Poppler::Page *p = mPdfDoc->page( i );
-#else
-        Poppler::Page *p = mPdfDoc->page( i ).release();
-#endif
-
-        PdfPage *page = new PdfPage( i );
-        page->setPageData( p );
-        mPages.append( page );
-
-        emit loading( 1.0 * i / mPdfDoc->numPages() * 100.0 );
-    }
+    createPages();
 
     mStatus = Ready;
     mError  = NoError;
@@ -138,19 +132,7 @@ void PopplerDocument::load() {
     mPdfDoc->setRenderHint( Poppler::Document::TextAntialiasing );
     mPdfDoc->setRenderHint( Poppler::Document::TextHinting );
 
-    for ( int i = 0; i < mPdfDoc->numPages(); i++ ) {
-#if QT_VERSION < QT_VERSION_CHECK( 6, 0, 0 )
-        Poppler::Page *p = mPdfDoc->page( i );
-#else
-        Poppler::Page *p = mPdfDoc->page( i ).release();
-#endif
-
-        PdfPage *page = new PdfPage( i );
-        page->setPageData( p );
-        mPages.append( page );
-
-        emit loading( 1.0 * i / mPdfDoc->numPages() * 100.0 );
-    }
+    createPages();
 
     mStatus = Ready;
     mError  = NoError;
@@ -161,10 +143,23 @@ void PopplerDocument::load() {
 }
 
 
+void PopplerDocument::createPages() {
+    const int count = mPdfDoc->numPages();
+
+    /* Only the page count is needed up front: Poppler::Page objects are created on first use */
+    mPages.reserve( count );
+
+    for ( int i = 0; i < count; i++ ) {
+        mPages.append( new PdfPage( i, mPdfDoc.get() ) );
+    }
+}
+
+
 void PopplerDocument::close() {
     mStatus = Unloading;
     emit statusChanged( Unloading );
 
+    resetPageSizes();
     mPages.clear();
     mZoom = 1.0;
 
@@ -172,8 +167,8 @@ void PopplerDocument::close() {
 }
 
 
-PdfPage::PdfPage( int pgNo ) : QDocumentPage( pgNo ) {
-    // Nothing much to be done here
+PdfPage::PdfPage( int pgNo, Poppler::Document *doc ) : QDocumentPage( pgNo ) {
+    mPdfDoc = doc;
 }
 
 
@@ -183,23 +178,41 @@ PdfPage::~PdfPage() {
 
 
 void PdfPage::setPageData( void *data ) {
+    QMutexLocker locker( &mPageLock );
+
     m_page = std::unique_ptr<Poppler::Page>( (Poppler::Page *)data );
 }
 
 
+Poppler::Page * PdfPage::popplerPage() const {
+    /* The render threads may ask for the same page at once */
+    QMutexLocker locker( &mPageLock );
+
+    if ( not m_page and mPdfDoc ) {
+#if QT_VERSION < QT_VERSION_CHECK( 6, 0, 0 )
+        m_page = std::unique_ptr<Poppler::Page>( mPdfDoc->page( mPageNo ) );
+#else
+        m_page = mPdfDoc->page( mPageNo );
+#endif
+    }
+
+    return m_page.get();
+}
+
+
 QSizeF PdfPage::pageSize( qreal zoom ) const {
-    return m_page->pageSizeF() * zoom;
+    return popplerPage()->pageSizeF() * zoom;
 }
 
 
 QImage PdfPage::thumbnail() const {
-    return m_page->thumbnail();
+    return popplerPage()->thumbnail();
 }
 
 
 QImage PdfPage::render( QSize pSize, QDocumentRenderOptions opts ) const {
-    qreal wZoom = 1.0 * pSize.width() / m_page->pageSizeF().width();
-    qreal hZoom = 1.0 * pSize.height() / m_page->pageSizeF().height();
+    qreal wZoom = 1.0 * pSize.width() / popplerPage()->pageSizeF().width();
+    qreal hZoom = 1.0 * pSize.height() / popplerPage()->pageSizeF().height();
 
     switch ( opts.rotation() ) {
         case QDocumentRenderOptions::Rotate90: {
@@ -216,17 +229,48 @@ QImage PdfPage::render( QSize pSize, QDocumentRenderOptions opts ) const {
         }
     }
 
-    return m_page->renderToImage( 72 * wZoom, 72 * hZoom, -1, -1, -1, -1, ( Poppler::Page::Rotation )opts.rotation() );
+    return popplerPage()->renderToImage( 72 * wZoom, 72 * hZoom, -1, -1, -1, -1, ( Poppler::Page::Rotation )opts.rotation() );
 }
 
 
 QImage PdfPage::render( qreal zoomFactor, QDocumentRenderOptions opts ) const {
-    return m_page->renderToImage( 72 * zoomFactor, 72 * zoomFactor, -1, -1, -1, -1, ( Poppler::Page::Rotation )opts.rotation() );
+    return popplerPage()->renderToImage( 72 * zoomFactor, 72 * zoomFactor, -1, -1, -1, -1, ( Poppler::Page::Rotation )opts.rotation() );
 }
 
 
 QImage PdfPage::render( int dpiX, int dpiY, QDocumentRenderOptions opts ) const {
-    return m_page->renderToImage( dpiX, dpiY, -1, -1, -1, -1, ( Poppler::Page::Rotation )opts.rotation() );
+    return popplerPage()->renderToImage( dpiX, dpiY, -1, -1, -1, -1, ( Poppler::Page::Rotation )opts.rotation() );
+}
+
+
+QImage PdfPage::renderTile( QSize pSize, QRect tile, QDocumentRenderOptions opts ) const {
+    qreal wZoom = 1.0 * pSize.width() / popplerPage()->pageSizeF().width();
+    qreal hZoom = 1.0 * pSize.height() / popplerPage()->pageSizeF().height();
+
+    switch ( opts.rotation() ) {
+        case QDocumentRenderOptions::Rotate90: {
+            [[fallthrough]];
+        }
+
+        case QDocumentRenderOptions::Rotate270: {
+            std::swap( wZoom, hZoom );
+            break;
+        }
+
+        default: {
+            break;
+        }
+    }
+
+    /** Poppler takes the sub-rect in the pixel coordinates of the rotated page */
+    return popplerPage()->renderToImage(
+        72 * wZoom, 72 * hZoom, tile.x(), tile.y(), tile.width(), tile.height(), ( Poppler::Page::Rotation )opts.rotation()
+    );
+}
+
+
+bool PdfPage::canRenderTiles() const {
+    return true;
 }
 
 
@@ -236,12 +280,12 @@ QString PdfPage::pageText() const {
 
 
 QString PdfPage::text( QRectF rect ) const {
-    return m_page->text( rect );
+    return popplerPage()->text( rect );
 }
 
 
 QList<QRectF> PdfPage::search( QString query, QDocumentRenderOptions opts ) const {
-    return m_page->search(
+    return popplerPage()->search(
         query,                                                                                      // Search
                                                                                                     // text
         Poppler::Page::IgnoreCase | Poppler::Page::IgnoreDiacritics,                                // Case
@@ -249,3 +293,59 @@ QList<QRectF> PdfPage::search( QString query, QDocumentRenderOptions opts ) cons
         ( Poppler::Page::Rotation )opts.rotation()                                                  // Rotation
     );
 }
+
+
+bool PdfPage::hasTextLayout() const {
+    return true;
+}
+
+
+QDocumentPageText PdfPage::textLayout() const {
+    QDocumentPageText layout;
+
+#if QT_VERSION < QT_VERSION_CHECK( 6, 0, 0 )
+    QList<Poppler::TextBox *> words = popplerPage()->textList();
+#else
+    std::vector<std::unique_ptr<Poppler::TextBox> > words = popplerPage()->textList();
+#endif
+
+    const int count = int( words.size() );
+
+    for ( int w = 0; w < count; w++ ) {
+        /* A plain pointer with Qt5, a std::unique_ptr with Qt6 */
+        Poppler::TextBox *word = &*words[ w ];
+
+        const QString text = word->text();
+
+        for ( int i = 0; i < text.length(); i++ ) {
+            layout.text += text.at( i );
+            layout.boxes << word->charBoundingBox( i );
+        }
+
+        /** Matches may span words, but not lines: the next word is on a new line if it begins below this one */
+        Poppler::TextBox *next = word->nextWord();
+
+        if ( next == nullptr ) {
+            if ( w + 1 < count ) {
+                layout.text += '\n';
+                layout.boxes << QRectF();
+            }
+        }
+
+        else if ( next->boundingBox().top() > word->boundingBox().center().y() ) {
+            layout.text += '\n';
+            layout.boxes << QRectF();
+        }
+
+        else if ( word->hasSpaceAfter() ) {
+            layout.text += ' ';
+            layout.boxes << QRectF();
+        }
+    }
+
+#if QT_VERSION < QT_VERSION_CHECK( 6, 0, 0 )
+    qDeleteAll( words );
+#endif
+
+    return layout;
+}
@@ -137,6 +137,7 @@ void DjVuDocument::close() {
     mStatus = Unloading;
     emit statusChanged( Unloading );
 
+    resetPageSizes();
     mPages.clear();
     mZoom = 1.0;
 
@@ -236,6 +237,56 @@ QImage DjPage::render( QSize pSize, QDocumentRenderOptions opts ) const {
 }
 
 
+QImage DjPage::renderTile( QSize pSize, QRect tile, QDocumentRenderOptions opts ) const {
+    /* DjVu page render format */
+    unsigned int   masks[ 4 ] = { 0xff0000, 0xff00, 0xff, 0xff000000 };
+    ddjvu_format_t *fmt       = ddjvu_format_create( DDJVU_FORMAT_RGBMASK32, 4, masks );
+
+    ddjvu_page_set_rotation( m_page, (ddjvu_page_rotation_t)opts.rotation() );
+
+    /* The page rect is the whole page in the rotated output coordinates */
+    QSize rotated = pSize;
+
+    if ( (opts.rotation() == QDocumentRenderOptions::Rotate90) || (opts.rotation() == QDocumentRenderOptions::Rotate270) ) {
+        rotated.transpose();
+    }
+
+    ddjvu_rect_t pageRect;
+
+    pageRect.x = 0;
+    pageRect.y = 0;
+    pageRect.w = rotated.width();
+    pageRect.h = rotated.height();
+
+    /* The render rect is the part of the page we want */
+    ddjvu_rect_t renderRect;
+
+    renderRect.x = tile.x();
+    renderRect.y = tile.y();
+    renderRect.w = tile.width();
+    renderRect.h = tile.height();
+
+    /* Make DjVu decoder follow X11 conventions: Why? Because DjView4 does so... :P */
+    ddjvu_format_set_row_order( fmt, true );
+    ddjvu_format_set_y_direction( fmt, true );
+
+    QImage image( tile.size(), QImage::Format_RGB32 );
+
+    if ( not ddjvu_page_render( m_page, DDJVU_RENDER_COLOR, &pageRect, &renderRect, fmt, image.bytesPerLine(), (char *)image.bits() ) ) {
+        image = QImage();
+    }
+
+    ddjvu_format_release( fmt );
+
+    return image;
+}
+
+
+bool DjPage::canRenderTiles() const {
+    return true;
+}
+
+
 QImage DjPage::render( qreal zoomFactor, QDocumentRenderOptions opts ) const {
     return render( (mPageSize * zoomFactor).toSize(), opts );
 }
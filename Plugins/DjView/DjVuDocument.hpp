@@ -76,6 +76,10 @@ class DjPage : public QDocumentPage {
         QImage render( qreal zoomFactor, QDocumentRenderOptions ) const;
         QImage render( int dpiX, int dpiY, QDocumentRenderOptions ) const;
 
+        /* Render only a part of the page */
+        QImage renderTile( QSize, QRect tile, QDocumentRenderOptions ) const;
+        bool canRenderTiles() const;
+
         /* Page Text */
         QString pageText() const;
 
@@ -27,6 +27,9 @@ PsDocument::PsDocument( QString psPath ) : QDocument( psPath ) {
 
 
 PsDocument::~PsDocument() {
+    /* The size reader may still be querying our pages */
+    resetPageSizes();
+
     spectre_render_context_free( mRenderCtxt );
     mRenderCtxt = nullptr;
 
@@ -133,6 +136,7 @@ void PsDocument::close() {
     mStatus = Unloading;
     emit statusChanged( Unloading );
 
+    resetPageSizes();
     mPages.clear();
     mZoom = 1.0;
 }
@@ -101,8 +101,16 @@ QDocumentView::QDocumentView( QWidget *parent ) : QAbstractScrollArea( parent )
 
     /* Setup Page Renderer */
     connect(
-        impl->mPageRenderer, &QDocumentRenderer::pageRendered, [ = ]( int ) {
-            viewport()->update();
+        impl->mPageRenderer, &QDocumentRenderer::pageRendered, [ = ]( int page ) {
+            const QRect pageGeometry = impl->mDocumentLayout.pageGeometries.value( page );
+
+            if ( pageGeometry.isNull() ) {
+                viewport()->update();
+                return;
+            }
+
+            /** Repaint only the page that is ready, along with its highlight */
+            viewport()->update( pageGeometry.adjusted( -2, -2, 2, 2 ).translated( -impl->mViewPort.topLeft() ) );
         }
     );
 
@@ -224,87 +232,105 @@ QDocumentView::~QDocumentView() {
 
 
 QDocument * QDocumentView::load( QString path ) {
-    QDocument *doc;
+    QDocument *doc = impl->createDocument( path );
 
-    /** Inbuilt support */
-    if ( path.toLower().endsWith( "pdf" ) ) {
-        doc = new PopplerDocument( path );
+    if ( doc == nullptr ) {
+        return nullptr;
     }
 
-    /** Support via plugins */
-    else {
-        QDocumentPluginInterface *plugin = impl->findSupportedPlugin( path );
+    /* A background load still running is superseded */
+    impl->mLoadGeneration++;
 
-        if ( plugin != nullptr ) {
-            doc = plugin->document( path );
+    progress->show();
+    connect(
+        doc, &QDocument::loading, [ = ]( int pc ) {
+            progress->setValue( pc );
 
-            /** The plugin was not able to load the document */
-            if ( doc == nullptr ) {
-                return nullptr;
+            if ( pc == 100 ) {
+                progress->hide();
             }
-        }
 
-        else {
-            qWarning() << "Unknown document type:" << path;
-            return nullptr;
+            qApp->processEvents();
         }
+    );
+
+    doc->load();
+
+    if ( not impl->unlockDocument( doc ) ) {
+        return nullptr;
     }
 
+    /* Password has been supplied (if needed), document ready to be loaded */
+    setDocument( doc );
+
+    return doc;
+}
+
+
+QPointer<QDocument> QDocumentView::loadAsync( QString path ) {
+    QDocument *doc = impl->createDocument( path );
+
+    if ( doc == nullptr ) {
+        return nullptr;
+    }
+
+    /* Only the latest load is shown: the earlier ones are dropped as they finish */
+    const quint64 generation = ++impl->mLoadGeneration;
+
+    /* Signals from the loader thread: the progress bar is updated in the GUI thread */
     progress->show();
     connect(
-        doc, &QDocument::loading, [ = ]( int pc ) {
+        doc, &QDocument::loading, this, [ = ]( int pc ) {
+            if ( generation != impl->mLoadGeneration ) {
+                return;
+            }
+
             progress->setValue( pc );
 
             if ( pc == 100 ) {
                 progress->hide();
             }
+        }
+    );
 
-            qApp->processEvents();
+    /**
+     * Pages are created lazily: the document can be shown as soon as it's opened.
+     * The first layout uses page 0's size for all of them; the rest are read in the background.
+     */
+    QThread *loader = QThread::create(
+        [ doc ] () {
+            doc->load();
         }
     );
 
-    doc->load();
+    /* The loader cleans up after itself, even if the view is gone by the time it finishes */
+    QPointer<QDocumentView> view( this );
 
-    switch ( doc->error() ) {
-        case QDocument::NoError: {
-            break;
-        }
+    connect(
+        loader, &QThread::finished, loader, [ = ] () {
+            loader->deleteLater();
 
-        case QDocument::IncorrectPasswordError: {
-            bool ok    = true;
-            int  count = 0;
-            do {
-                QString passwd = QInputDialog::getText(
-                    this,
-                    "Encrypted Document",
-                    QString( "%1Please enter the document password:" ).arg( count ? "You may have entered the wrong password.<br>" : "" ),
-                    QLineEdit::Password,
-                    QString(),
-                    &ok,
-                    Qt::WindowFlags(),
-                    Qt::ImhSensitiveData
-                );
-
-                doc->setPassword( passwd );
-                count++;
-            } while ( ok == true and doc->passwordNeeded() );
-
-            /* User cancelled loading the document */
-            if ( not ok ) {
-                return nullptr;
+            /* The view was destroyed, or another document was loaded meanwhile */
+            if ( view.isNull() or (generation != impl->mLoadGeneration) ) {
+                doc->deleteLater();
+                return;
             }
 
-            /** Everything seems okay */
-            break;
-        }
+            progress->hide();
 
-        default: {
-            return nullptr;
+            /* Wrong password, or a broken file */
+            if ( not impl->unlockDocument( doc ) ) {
+                doc->deleteLater();
+                emit documentLoadingFailed();
+
+                return;
+            }
+
+            setDocument( doc );
         }
-    }
+    );
 
-    /* Password has been supplied (if needed), document ready to be loaded */
-    setDocument( doc );
+    loader->start();
 
     return doc;
 }
@@ -318,6 +344,7 @@ void QDocumentView::setDocument( QDocument *document ) {
     if ( impl->mDocument ) {
         disconnect( impl->mDocumentStatusChangedConnection );
         disconnect( impl->mReloadDocumentConnection );
+        disconnect( impl->mPageSizesChangedConnection );
     }
 
     impl->mDocument = document;
@@ -325,7 +352,7 @@ void QDocumentView::setDocument( QDocument *document ) {
 
     if ( impl->mDocument ) {
         impl->mDocumentStatusChangedConnection = connect(
-            impl->mDocument, &QDocument::statusChanged, [ = ]( QDocument::Status sts ) {
+            impl->mDocument, &QDocument::statusChanged, this, [ = ]( QDocument::Status sts ) {
                 if ( sts == QDocument::Loading ) {
                     progress->show();
                 }
@@ -357,6 +384,13 @@ void QDocumentView::setDocument( QDocument *document ) {
             Qt::DirectConnection
         );
 
+        /* The pages were laid out at a provisional size: relayout once the real ones stop arriving */
+        impl->mPageSizesChangedConnection = connect(
+            impl->mDocument, &QDocument::pageSizesChanged, this, [ this ]() {
+                impl->mRelayoutTimer->start();
+            }
+        );
+
         impl->mReloadDocumentConnection = connect(
             impl->mDocument, &QDocument::documentReloaded, [ this ]() mutable {
                 impl->mPageRenderer->reload();
@@ -401,6 +435,11 @@ QDocumentNavigation *QDocumentView::pageNavigation() const {
 }
 
 
+QDocumentRenderer *QDocumentView::pageRenderer() const {
+    return impl->mPageRenderer;
+}
+
+
 bool QDocumentView::isLayoutContinuous() const {
     return impl->mContinuous;
 }
@@ -701,30 +740,93 @@ void QDocumentView::paintEvent( QPaintEvent *event ) {
         return;
     }
 
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
+    /** Moved to another screen: lay the pages out for its resolution, once it settles */
+    if ( (impl->logicalResolution() != impl->mScreenResolution) and not impl->mRelayoutTimer->isActive() ) {
+        impl->mRelayoutTimer->start();
+    }
+
+    /** Render for the pixel density of this screen: the images are drawn at their logical size */
+    impl->mPageRenderer->setDevicePixelRatio( viewport()->devicePixelRatioF() );
+
     QPainter painter( viewport() );
 
     painter.fillRect( event->rect(), palette().brush( QPalette::Dark ) );
     painter.translate( -impl->mViewPort.x(), -impl->mViewPort.y() );
 
-    for ( auto it = impl->mDocumentLayout.pageGeometries.cbegin(); it != impl->mDocumentLayout.pageGeometries.cend(); ++it ) {
-        const QRect pageGeometry = it.value();
+    /** The part that needs repainting, in document coordinates: only the strip exposed by a scroll, for example */
+    const QRect dirty = event->rect().translated( impl->mViewPort.topLeft() );
 
-        if ( pageGeometry.intersects( impl->mViewPort ) ) {
-            if ( it.key() == impl->mDocState.currentPage ) {
+    const QDocumentViewImpl::PageGeometries& pageGeometries = impl->mDocumentLayout.pageGeometries;
+
+    /** Only the pages in the viewport: the cost of a frame does not grow with the page count */
+    const QPair<int, int> visible = impl->visiblePageRange();
+
+    for ( int page = visible.first; (page != -1) and (page <= visible.second); page++ ) {
+        const QRect pageGeometry = pageGeometries.value( page );
+
+        if ( pageGeometry.adjusted( -2, -2, 2, 2 ).intersects( dirty ) ) {
+            if ( page == impl->mDocState.currentPage ) {
                 painter.fillRect( QRectF( pageGeometry ).adjusted( -2, -2, 2, 2 ), qApp->palette().color( QPalette::Highlight ) );
             }
 
             painter.fillRect( pageGeometry, impl->mPageColor );
 
-            const int page = it.key();
-            QImage    img  = impl->mPageRenderer->requestPage( page, pageGeometry.size(), impl->mRenderOpts );
+            /** Zooming or resizing: stretch whatever we have; the pages are rendered once the layout settles */
+            const bool settling = impl->mZooming or pageGeometries.isScaled();
+            QImage     placeholder;
 
-            if ( img.width() and img.height() ) {
-                impl->paintOverlayRects( page, img );
-                painter.drawImage( pageGeometry.topLeft(), img );
+            if ( settling ) {
+                placeholder = impl->mPageRenderer->placeholderPage( page, pageGeometry.size(), impl->mRenderOpts );
             }
+
+            if ( not placeholder.isNull() ) {
+                painter.drawImage( pageGeometry, placeholder );
+            }
+
+            /** Large pages (high zoom): render and paint only the visible tiles; none at the intermediate sizes */
+            else if ( impl->mPageRenderer->isTiled( page, pageGeometry.size() ) ) {
+                if ( not settling ) {
+                    impl->paintPageTiles( painter, page, pageGeometry );
+                }
+            }
+
+            else {
+                QImage img = impl->mPageRenderer->requestPage( page, pageGeometry.size(), impl->mRenderOpts );
+
+                if ( img.width() and img.height() ) {
+                    painter.drawImage( pageGeometry.topLeft(), img );
+                }
+            }
+
+            /** Search highlights go over the page: the cached images are never modified */
+            impl->paintOverlayRects( painter, page, pageGeometry );
         }
     }
+
+    impl->recordFrameTime( frameTimer.nsecsElapsed() / 1000 );
+}
+
+
+bool QDocumentView::scrollBlitting() const {
+    return impl->mScrollBlitting;
+}
+
+
+void QDocumentView::setScrollBlitting( bool yes ) {
+    impl->mScrollBlitting = yes;
+}
+
+
+qint64 QDocumentView::lastFrameTime() const {
+    return impl->mLastFrameTime;
+}
+
+
+qreal QDocumentView::averageFrameTime() const {
+    return impl->mAverageFrameTime;
 }
 
 
@@ -744,18 +846,9 @@ void QDocumentView::resizeEvent( QResizeEvent *event ) {
 
         impl->updateScrollBars();
 
-        if ( impl->pendingResize ) {
-            return;
-        }
-
-        impl->pendingResize = true;
-        QTimer::singleShot(
-            250, [ = ]() {
-                impl->calculateViewport();
-                viewport()->update();
-                impl->pendingResize = false;
-            }
-        );
+        /** Scaling the layout is cheap: follow the resize at once, and let the relayout timer settle it */
+        impl->calculateViewport();
+        viewport()->update();
     }
 
     else {
@@ -765,7 +858,36 @@ void QDocumentView::resizeEvent( QResizeEvent *event ) {
 
 
 void QDocumentView::scrollContentsBy( int dx, int dy ) {
-    QAbstractScrollArea::scrollContentsBy( dx, dy );
+    /** Move what's already painted: only the exposed strip will be painted afresh */
+    if ( impl->mScrollBlitting ) {
+        /**
+         * Qt does not blit an area that a sibling overlaps: it repaints all of it instead.
+         * The toolbar floats over the bottom of the viewport, so scroll only what's above it,
+         * and repaint the band under it.
+         */
+        QRect blit = viewport()->rect();
+
+        if ( toolBar->isVisible() ) {
+            const QRect bar = toolBar->geometry().translated( -viewport()->pos() ) & blit;
+
+            if ( not bar.isEmpty() ) {
+                blit.setBottom( bar.top() - 1 );
+            }
+        }
+
+        viewport()->scroll( dx, dy, blit );
+
+        if ( blit != viewport()->rect() ) {
+            viewport()->update( QRegion( viewport()->rect() ) - blit );
+        }
+    }
+
+    else {
+        QAbstractScrollArea::scrollContentsBy( dx, dy );
+    }
+
+    /** Direction and speed of the scroll decide what we prefetch */
+    impl->updateScrollVelocity( dy );
 
     impl->calculateViewport();
 }
@@ -830,6 +952,9 @@ void QDocumentView::wheelEvent( QWheelEvent *wEvent ) {
     if ( wEvent->modifiers() & Qt::ControlModifier ) {
         QPoint numDegrees = wEvent->angleDelta() / 8;
 
+        /** Each notch is a step of the gesture: rendering waits until the last one */
+        impl->zoomGestureStep();
+
         if ( numDegrees.y() > 0 ) {
             setZoomFactor( impl->mZoomFactor * 1.10 );
         }
@@ -848,6 +973,9 @@ void QDocumentView::wheelEvent( QWheelEvent *wEvent ) {
     else if ( qApp->mouseButtons() == Qt::RightButton ) {
         QPoint numDegrees = wEvent->angleDelta() / 8;
 
+        /** Each notch is a step of the gesture: rendering waits until the last one */
+        impl->zoomGestureStep();
+
         if ( numDegrees.y() > 0 ) {
             setZoomFactor( impl->mZoomFactor * 1.10 );
         }
@@ -24,6 +24,7 @@
 #include <qdocumentview/QDocument.hpp>
 #include <qdocumentview/QDocumentNavigation.hpp>
 #include <qdocumentview/QDocumentSearch.hpp>
+#include <qdocumentview/PopplerDocument.hpp>
 
 #include "ViewImpl.hpp"
 
@@ -32,6 +33,8 @@
 #include <QScrollBar>
 #include <QScroller>
 
+#include <algorithm>
+
 #include <QPrinter>
 #include <QPrintEngine>
 
@@ -53,9 +56,36 @@ QDocumentViewImpl::QDocumentViewImpl( QDocumentView *view ) {
     mDocState.currentPage     = 0;
     mDocState.currentPosition = QPointF( 0, 0 );
 
+    mScreenResolution = logicalResolution();
+
     mPageNavigation = new QDocumentNavigation( view );
     mPageRenderer   = new QDocumentRenderer( view );
     mSearchThread   = new QDocumentSearch( view );
+
+    mZoomSettleTimer = new QTimer( view );
+    mZoomSettleTimer->setSingleShot( true );
+    mZoomSettleTimer->setInterval( 250 );
+
+    QObject::connect(
+        mZoomSettleTimer, &QTimer::timeout, [ = ] () {
+            mZooming = false;
+
+            /** Render the pages at the final zoom */
+            updateRenderPriorities();
+            publ->viewport()->update();
+        }
+    );
+
+    mRelayoutTimer = new QTimer( view );
+    mRelayoutTimer->setSingleShot( true );
+    mRelayoutTimer->setInterval( 150 );
+
+    QObject::connect(
+        mRelayoutTimer, &QTimer::timeout, [ = ] () {
+            invalidateDocumentLayout();
+            publ->viewport()->update();
+        }
+    );
 }
 
 
@@ -108,7 +138,23 @@ void QDocumentViewImpl::setViewport( QRect viewport ) {
     mViewPort = viewport;
 
     if ( oldSize != mViewPort.size() ) {
-        invalidateDocumentLayout();
+        /** Resizing: scale what we have, the exact layout follows when it stops */
+        switch ( scaleDocumentLayout( oldSize ) ) {
+            case RelayoutNow: {
+                invalidateDocumentLayout();
+                break;
+            }
+
+            /** Restarted with every step of the resize: it fires once the resizing stops */
+            case RelayoutLater: {
+                mRelayoutTimer->start();
+                break;
+            }
+
+            case LayoutExact: {
+                break;
+            }
+        }
     }
 
     if ( mContinuous ) {
@@ -118,11 +164,13 @@ void QDocumentViewImpl::setViewport( QRect viewport ) {
         const QRect currentPageLine( mViewPort.x(), mViewPort.y() + mViewPort.height() * 0.4, mViewPort.width(), 2 );
 
         int currentPage = 0;
-        for ( auto it = mDocumentLayout.pageGeometries.cbegin(); it != mDocumentLayout.pageGeometries.cend(); ++it ) {
-            const QRect pageGeometry = it.value();
 
-            if ( pageGeometry.intersects( currentPageLine ) ) {
-                currentPage = it.key();
+        /** Only the pages in the rows of the line need be checked */
+        const QPair<int, int> candidates = mDocumentLayout.pageGeometries.pagesBetween( currentPageLine.top(), currentPageLine.bottom() );
+
+        for ( int page = candidates.first; (page != -1) and (page <= candidates.second); page++ ) {
+            if ( mDocumentLayout.pageGeometries.value( page ).intersects( currentPageLine ) ) {
+                currentPage = page;
                 break;
             }
         }
@@ -132,8 +180,112 @@ void QDocumentViewImpl::setViewport( QRect viewport ) {
             mDocState.currentPage = currentPage;
             mPageNavigation->setCurrentPage( currentPage );
             mBlockPageScrolling = false;
+
+            /** The highlight moved to another page: the scrolled contents are stale */
+            publ->viewport()->update();
+        }
+    }
+
+    updateRenderPriorities();
+}
+
+
+void QDocumentViewImpl::updateScrollVelocity( int dy ) {
+    if ( dy == 0 ) {
+        return;
+    }
+
+    /** The contents move up (dy < 0) when we scroll down */
+    mScrollDirection = (dy < 0 ? 1 : -1);
+
+    if ( not mScrollTimer.isValid() ) {
+        mScrollTimer.start();
+        mScrollVelocity = 0.0;
+        return;
+    }
+
+    const qint64 elapsed = mScrollTimer.restart();
+
+    /** A long pause means the previous scroll was a separate gesture */
+    if ( (elapsed <= 0) or (elapsed > 500) ) {
+        mScrollVelocity = 0.0;
+    }
+
+    else {
+        mScrollVelocity = 1.0 * qAbs( dy ) / elapsed;
+    }
+}
+
+
+QPair<int, int> QDocumentViewImpl::visiblePageRange() const {
+    return mDocumentLayout.pageGeometries.pagesBetween( mViewPort.top(), mViewPort.bottom() );
+}
+
+
+void QDocumentViewImpl::updateRenderPriorities() {
+    if ( not mDocument or (mDocument->status() != QDocument::Ready) ) {
+        return;
+    }
+
+    const QPair<int, int> visible = visiblePageRange();
+
+    if ( visible.first == -1 ) {
+        return;
+    }
+
+    QHash<int, QSize> pages;
+
+    /** Speculation makes sense only when we scroll through the pages, and not while zooming or resizing */
+    if ( mContinuous and not mZooming and not mDocumentLayout.pageGeometries.isScaled() ) {
+        /** Fast scrolling (about a page a second per px/ms) needs a longer look-ahead */
+        int ahead  = mPageRenderer->prefetchAhead();
+        int behind = mPageRenderer->prefetchBehind();
+
+        ahead += qMin( qFloor( mScrollVelocity * 2 ), ahead );
+
+        if ( mScrollDirection < 0 ) {
+            std::swap( ahead, behind );
+        }
+
+        for ( int page = visible.second + 1; page <= visible.second + ahead; page++ ) {
+            if ( mDocumentLayout.pageGeometries.contains( page ) ) {
+                pages[ page ] = mDocumentLayout.pageGeometries.value( page ).size();
+            }
         }
+
+        for ( int page = visible.first - 1; page >= visible.first - behind; page-- ) {
+            if ( mDocumentLayout.pageGeometries.contains( page ) ) {
+                pages[ page ] = mDocumentLayout.pageGeometries.value( page ).size();
+            }
+        }
+    }
+
+    mPageRenderer->prefetchPages( pages, mRenderOpts );
+
+    /** Visible pages first; requests for pages (and tiles) that went out of view are withdrawn */
+    QHash<int, QRect> visiblePages;
+
+    for ( int page = visible.first; page <= visible.second; page++ ) {
+        const QRect pageGeometry = mDocumentLayout.pageGeometries.value( page );
+
+        visiblePages[ page ] = pageGeometry.intersected( mViewPort ).translated( -pageGeometry.topLeft() );
     }
+
+    mPageRenderer->setVisiblePages( visiblePages );
+}
+
+
+void QDocumentViewImpl::recordFrameTime( qint64 usecs ) {
+    mLastFrameTime = usecs;
+
+    /** Roughly, the average of the last ten frames */
+    mAverageFrameTime = (mAverageFrameTime == 0.0 ? usecs : 0.9 * mAverageFrameTime + 0.1 * usecs);
+}
+
+
+void QDocumentViewImpl::zoomGestureStep() {
+    mZooming = true;
+    mZoomSettleTimer->start();
 }
 
 
@@ -160,10 +312,185 @@ void QDocumentViewImpl::updateScrollBars() {
 }
 
 
+qreal QDocumentViewImpl::logicalResolution() const {
+    QScreen *screen = nullptr;
+
+    /** The screen showing the view: with several monitors, it need not be the primary screen */
+#if QT_VERSION >= QT_VERSION_CHECK( 5, 14, 0 )
+    screen = publ->screen();
+#endif
+
+    if ( screen == nullptr ) {
+        screen = QGuiApplication::primaryScreen();
+    }
+
+    return screen->logicalDotsPerInch() / 72.0;
+}
+
+
 void QDocumentViewImpl::invalidateDocumentLayout() {
-    mDocumentLayout = calculateDocumentLayout();
+    mScreenResolution = logicalResolution();
+    mDocumentLayout   = calculateDocumentLayout();
+
+    updateScrollBars();
+
+    /** Page sizes may have changed: prefetch at the new zoom */
+    updateRenderPriorities();
+}
+
+
+QDocumentViewImpl::ResizeLayout QDocumentViewImpl::scaleDocumentLayout( QSize oldSize ) {
+    if ( oldSize.isEmpty() or mDocumentLayout.documentSize.isEmpty() ) {
+        return RelayoutNow;
+    }
+
+    const int horizMargins = mDocumentMargins.left() + mDocumentMargins.right();
+    const int vertMargins  = mDocumentMargins.top() + mDocumentMargins.bottom();
+
+    /** The margins took up the whole of the old viewport: there's nothing to scale from */
+    if ( (oldSize.width() <= horizMargins) or (oldSize.height() <= vertMargins) ) {
+        return RelayoutNow;
+    }
+
+    const qreal wFactor = qreal( mViewPort.width() - horizMargins ) / qreal( oldSize.width() - horizMargins );
+    const qreal hFactor = qreal( mViewPort.height() - vertMargins ) / qreal( oldSize.height() - vertMargins );
+
+    qreal factor;
+
+    switch ( mZoomMode ) {
+        /** Page sizes follow the viewport width */
+        case QDocumentView::FitToWidth: {
+            factor = wFactor;
+            break;
+        }
+
+        /** Page sizes follow the limiting dimension */
+        case QDocumentView::FitInView: {
+            factor = qMin( wFactor, hFactor );
+            break;
+        }
+
+        /** Page sizes do not change; the pages are centered afresh once the width settles */
+        default: {
+            updateScrollBars();
+            return (oldSize.width() == mViewPort.width() ? LayoutExact : RelayoutLater);
+        }
+    }
+
+    if ( factor <= 0 ) {
+        return RelayoutNow;
+    }
+
+    /** Page sizes are unchanged: only the scroll bars follow */
+    if ( qFuzzyCompare( factor, 1.0 ) ) {
+        updateScrollBars();
+
+        /** Only the width matters to a FitToWidth layout: a change in height leaves it exact */
+        return (mZoomMode == QDocumentView::FitToWidth ? LayoutExact : RelayoutLater);
+    }
+
+    mDocumentLayout.pageGeometries.scale( factor );
+    mDocumentLayout.documentSize = ( QSizeF( mDocumentLayout.documentSize ) * factor ).toSize();
 
     updateScrollBars();
+
+    return RelayoutLater;
+}
+
+
+void QDocumentViewImpl::PageGeometries::reset( int first ) {
+    mFirstPage = first;
+    mScale     = 1.0;
+    mRects.clear();
+    mMaxBottoms.clear();
+}
+
+
+void QDocumentViewImpl::PageGeometries::finalize() {
+    mMaxBottoms.resize( mRects.count() );
+
+    int maxBottom = INT_MIN;
+
+    for ( int i = 0; i < mRects.count(); i++ ) {
+        /** Pages side by side may differ in height: keep the lowest edge so far */
+        if ( not mRects.at( i ).isNull() ) {
+            maxBottom = qMax( maxBottom, mRects.at( i ).bottom() );
+        }
+
+        mMaxBottoms[ i ] = maxBottom;
+    }
+}
+
+
+bool QDocumentViewImpl::PageGeometries::contains( int page ) const {
+    const int idx = page - mFirstPage;
+
+    return (idx >= 0) and (idx < mRects.count() ) and not mRects.at( idx ).isNull();
+}
+
+
+QRect QDocumentViewImpl::PageGeometries::value( int page ) const {
+    const int idx = page - mFirstPage;
+
+    if ( (idx < 0) or (idx >= mRects.count() ) ) {
+        return QRect();
+    }
+
+    const QRect rect = mRects.at( idx );
+
+    if ( mScale == 1.0 ) {
+        return rect;
+    }
+
+    return QRectF( QPointF( rect.topLeft() ) * mScale, QSizeF( rect.size() ) * mScale ).toRect();
+}
+
+
+QRect& QDocumentViewImpl::PageGeometries::operator[]( int page ) {
+    const int idx = page - mFirstPage;
+
+    if ( idx >= mRects.count() ) {
+        mRects.resize( idx + 1 );
+    }
+
+    return mRects[ idx ];
+}
+
+
+QPair<int, int> QDocumentViewImpl::PageGeometries::pagesBetween( int top, int bottom ) const {
+    if ( mMaxBottoms.isEmpty() or (top > bottom) ) {
+        return qMakePair( -1, -1 );
+    }
+
+    /** The rects are stored unscaled */
+    top    = qFloor( top / mScale );
+    bottom = qCeil( bottom / mScale );
+
+    /** First page whose bottom edge (or that of an earlier page in its row) reaches @top */
+    const int first = std::lower_bound( mMaxBottoms.cbegin(), mMaxBottoms.cend(), top ) - mMaxBottoms.cbegin();
+
+    /** Last page whose top edge is above @bottom */
+    const int last = std::upper_bound(
+        mRects.cbegin(), mRects.cend(), bottom, [] ( int y, const QRect& rect ) {
+            return y < rect.top();
+        }
+    ) - mRects.cbegin() - 1;
+
+    if ( (first >= mRects.count() ) or (last < first) ) {
+        return qMakePair( -1, -1 );
+    }
+
+    return qMakePair( mFirstPage + first, mFirstPage + last );
+}
+
+
+void QDocumentViewImpl::PageGeometries::scale( qreal factor ) {
+    mScale *= factor;
+}
+
+
+bool QDocumentViewImpl::PageGeometries::isScaled() const {
+    return mScale != 1.0;
 }
 
 
@@ -201,7 +528,7 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutSing
         return documentLayout;
     }
 
-    QHash<int, QRect> pageGeometries;
+    PageGeometries pageGeometries;
 
     const int pageCount = mDocument->pageCount() - 1;
 
@@ -213,11 +540,17 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutSing
     const int horizMargins = mDocumentMargins.left() + mDocumentMargins.right();
     int       pageY        = mDocumentMargins.top();
 
-    qreal screenResolution = QGuiApplication::primaryScreen()->logicalDotsPerInch() / 72.0;
+    qreal screenResolution = logicalResolution();
+
+    /** All the page sizes at once: a flat array, instead of a call into the backend per page */
+    const QVector<QSizeF> pageSizes = mDocument->pageSizes();
+    const qreal           pageScale = screenResolution * mDocument->zoom();
+
+    pageGeometries.reset( startPage );
 
     // calculate page sizes
     for (int page = startPage; page <= endPage; ++page) {
-        QSizeF pageSize = mDocument->pageSize( page ) * screenResolution;
+        QSizeF pageSize = pageSizes.at( page ) * pageScale;
 
         switch ( mRenderOpts.rotation() ) {
             /* 90 degree rotated */
@@ -268,6 +601,7 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutSing
     /** We added an amount 'mPageSpacing' amount extra */
     pageY += mDocumentMargins.bottom() - mPageSpacing;
 
+    pageGeometries.finalize();
     documentLayout.pageGeometries = pageGeometries;
 
     // calculate overall document size
@@ -284,7 +618,7 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutFaci
         return documentLayout;
     }
 
-    QHash<int, QRect> pageGeometries;
+    PageGeometries pageGeometries;
 
     const int pageCount = mDocument->pageCount() - 1;
     const int curPage   = mPageNavigation->currentPage();
@@ -308,17 +642,23 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutFaci
 
     const int horizMargins = mDocumentMargins.left() + mDocumentMargins.right();
 
-    qreal screenResolution = QGuiApplication::primaryScreen()->logicalDotsPerInch() / 72.0;
+    qreal screenResolution = logicalResolution();
+
+    /** All the page sizes at once: a flat array, instead of a call into the backend per page */
+    const QVector<QSizeF> pageSizes = mDocument->pageSizes();
+    const qreal           pageScale = screenResolution * mDocument->zoom();
+
+    pageGeometries.reset( startPage );
 
     // calculate page sizes
     for (int page = startPage; page <= endPage; page += 2) {
         QSizeF pageSize;
 
-        QSizeF p1 = mDocument->pageSize( page ) * screenResolution;
+        QSizeF p1 = pageSizes.at( page ) * pageScale;
         QSizeF p2;
 
         if ( page + 1 < mDocument->pageCount() ) {
-            p2 = mDocument->pageSize( page + 1 ) * screenResolution;
+            p2 = pageSizes.at( page + 1 ) * pageScale;
         }
 
         switch ( mRenderOpts.rotation() ) {
@@ -404,6 +744,7 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutFaci
 
     pageY += mDocumentMargins.bottom() - mPageSpacing;
 
+    pageGeometries.finalize();
     documentLayout.pageGeometries = pageGeometries;
 
     // calculate overall document size
@@ -420,7 +761,7 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutBook
         return documentLayout;
     }
 
-    QHash<int, QRect> pageGeometries;
+    PageGeometries pageGeometries;
 
     const int pageCount = mDocument->pageCount() - 1;
     const int curPage   = mPageNavigation->currentPage();
@@ -452,12 +793,18 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutBook
 
     const int horizMargins = mDocumentMargins.left() + mDocumentMargins.right();
 
-    qreal screenResolution = QGuiApplication::primaryScreen()->logicalDotsPerInch() / 72.0;
+    qreal screenResolution = logicalResolution();
+
+    /** All the page sizes at once: a flat array, instead of a call into the backend per page */
+    const QVector<QSizeF> pageSizes = mDocument->pageSizes();
+    const qreal           pageScale = screenResolution * mDocument->zoom();
+
+    pageGeometries.reset( startPage );
 
     // calculate page sizes
     /** First page */
     if ( startPage == 0 ) {
-        QSizeF p1 = mDocument->pageSize( 0 ) * screenResolution;
+        QSizeF p1 = pageSizes.at( 0 ) * pageScale;
 
         switch ( mRenderOpts.rotation() ) {
             /* 90 degree rotated */
@@ -495,11 +842,11 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutBook
     for (int page = (startPage == 0 ? 1 : startPage); page <= endPage; page += 2) {
         QSizeF pageSize;
 
-        QSizeF p1 = mDocument->pageSize( page ) * screenResolution;
+        QSizeF p1 = pageSizes.at( page ) * pageScale;
         QSizeF p2( 0, 0 );
 
         if ( page + 1 < mDocument->pageCount() ) {
-            p2 = mDocument->pageSize( page + 1 ) * screenResolution;
+            p2 = pageSizes.at( page + 1 ) * pageScale;
         }
 
         switch ( mRenderOpts.rotation() ) {
@@ -597,6 +944,7 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutBook
 
     pageY += mDocumentMargins.bottom() - mPageSpacing;
 
+    pageGeometries.finalize();
     documentLayout.pageGeometries = pageGeometries;
 
     // calculate overall document size
@@ -612,13 +960,11 @@ QDocumentViewImpl::DocumentLayout QDocumentViewImpl::calculateDocumentLayoutOver
 
 
 qreal QDocumentViewImpl::yPositionForPage( int pageNumber ) const {
-    const auto it = mDocumentLayout.pageGeometries.constFind( pageNumber );
-
-    if ( it == mDocumentLayout.pageGeometries.cend() ) {
+    if ( not mDocumentLayout.pageGeometries.contains( pageNumber ) ) {
         return 0.0;
     }
 
-    return (*it).y();
+    return mDocumentLayout.pageGeometries.value( pageNumber ).y();
 }
 
 
@@ -644,7 +990,7 @@ qreal QDocumentViewImpl::zoomFactor() const {
 qreal QDocumentViewImpl::zoomFactorForFitWidth() const {
     int page = mPageNavigation->currentPage();
 
-    qreal screenResolution = QGuiApplication::primaryScreen()->logicalDotsPerInch() / 72.0;
+    qreal screenResolution = logicalResolution();
 
     QSize       pageSize = QSizeF( mDocument->pageSize( page ) * screenResolution ).toSize();
     const qreal factor   = (qreal( mViewPort.width() - mDocumentMargins.left() - mDocumentMargins.right() ) / qreal( pageSize.width() ) );
@@ -655,7 +1001,7 @@ qreal QDocumentViewImpl::zoomFactorForFitWidth() const {
 
 qreal QDocumentViewImpl::zoomFactorForFitHeight() const {
     const int   page             = mPageNavigation->currentPage();
-    const qreal screenResolution = QGuiApplication::primaryScreen()->logicalDotsPerInch() / 72.0;
+    const qreal screenResolution = logicalResolution();
 
     QSize       pageSize = QSizeF( mDocument->pageSize( page ) * screenResolution ).toSize();
     const qreal factor   = (qreal( mViewPort.height() - mDocumentMargins.top() - mDocumentMargins.bottom() ) / qreal( pageSize.height() ) );
@@ -741,7 +1087,7 @@ void QDocumentViewImpl::highlightFirstSearchInstance( int page, QVector<QRectF>
     searchPage    = page;
 
     /** Geometry of @page */
-    QRectF pageGeometry    = mDocumentLayout.pageGeometries[ page ];
+    QRectF pageGeometry    = mDocumentLayout.pageGeometries.value( page );
     QRectF transformedRect = getTransformedRect( curSearchRect, page, false );
 
     /** If this is the current page, make sure to focus the current search rect */
@@ -793,7 +1139,7 @@ void QDocumentViewImpl::highlightNextSearchInstance() {
     }
 
     /** Make the rectangle visible */
-    QRectF pageGeometry    = mDocumentLayout.pageGeometries[ searchPage ];
+    QRectF pageGeometry    = mDocumentLayout.pageGeometries.value( searchPage );
     QRectF transformedRect = getTransformedRect( curSearchRect, searchPage, false );
     makeRegionVisible( transformedRect, pageGeometry );
 }
@@ -834,7 +1180,7 @@ void QDocumentViewImpl::highlightPreviousSearchInstance() {
     }
 
     /** Make the rectangle visible */
-    QRectF pageGeometry    = mDocumentLayout.pageGeometries[ searchPage ];
+    QRectF pageGeometry    = mDocumentLayout.pageGeometries.value( searchPage );
     QRectF transformedRect = getTransformedRect( curSearchRect, searchPage, false );
     makeRegionVisible( transformedRect, pageGeometry );
 }
@@ -864,7 +1210,7 @@ QPair<int, int> QDocumentViewImpl::getCurrentSearchPosition() {
 }
 
 
-void QDocumentViewImpl::paintOverlayRects( int page, QImage& img ) {
+void QDocumentViewImpl::paintOverlayRects( QPainter& painter, int page, QRect pageGeometry ) {
     /** Search Rects */
     if ( searchRects.contains( page ) ) {
         QColor hBrush = qApp->palette().color( QPalette::Highlight );
@@ -875,7 +1221,7 @@ void QDocumentViewImpl::paintOverlayRects( int page, QImage& img ) {
         }
 
         /** Page rectangle */
-        QRectF pgRect = mDocumentLayout.pageGeometries[ page ];
+        QRectF pgRect = mDocumentLayout.pageGeometries.value( page );
 
         if ( pgRect.isNull() ) {
             return;
@@ -907,9 +1253,8 @@ void QDocumentViewImpl::paintOverlayRects( int page, QImage& img ) {
             return;
         }
 
-        QPainter painter( &img );
-
         painter.save();
+        painter.translate( pageGeometry.topLeft() );
         painter.setRenderHint( QPainter::Antialiasing );
         painter.setCompositionMode( QPainter::CompositionMode_Darken );
 
@@ -936,13 +1281,46 @@ void QDocumentViewImpl::paintOverlayRects( int page, QImage& img ) {
         }
 
         painter.restore();
-        painter.end();
+    }
+}
+
+
+void QDocumentViewImpl::paintPageTiles( QPainter& painter, int page, QRect pageGeometry ) {
+    const int tileSize = mPageRenderer->tileSize();
+
+    /** Part of the page visible in the viewport, in page coordinates */
+    const QRect visible = pageGeometry.intersected( mViewPort ).translated( -pageGeometry.topLeft() );
+
+    if ( visible.isEmpty() ) {
+        return;
+    }
+
+    /** The whole page, stretched, under the tiles that are not yet rendered */
+    const QImage overview = mPageRenderer->placeholderPage( page, pageGeometry.size(), mRenderOpts );
+
+    if ( not overview.isNull() ) {
+        painter.drawImage( pageGeometry, overview );
+    }
+
+    for ( int row = visible.top() / tileSize; row <= visible.bottom() / tileSize; row++ ) {
+        for ( int col = visible.left() / tileSize; col <= visible.right() / tileSize; col++ ) {
+            QImage tile = mPageRenderer->requestTile( page, pageGeometry.size(), QPoint( col, row ), mRenderOpts );
+
+            /** Not yet rendered: we'll be notified when it's ready */
+            if ( tile.isNull() ) {
+                continue;
+            }
+
+            const QPoint offset( col * tileSize, row * tileSize );
+
+            painter.drawImage( pageGeometry.topLeft() + offset, tile );
+        }
     }
 }
 
 
 QRectF QDocumentViewImpl::getTransformedRect( QRectF rect, int page, bool inverse ) {
-    QRectF pgRect    = mDocumentLayout.pageGeometries[ page ];
+    QRectF pgRect    = mDocumentLayout.pageGeometries.value( page );
     QSizeF dPageSize = mDocument->pageSize( page );
     QSizeF rPageSize = pgRect.size();
 
@@ -1470,3 +1848,58 @@ QDocumentPluginInterface * QDocumentViewImpl::findSupportedPlugin( QString path
 
     return nullptr;
 }
+
+
+QDocument * QDocumentViewImpl::createDocument( QString path ) {
+    /** Inbuilt support */
+    if ( path.toLower().endsWith( "pdf" ) ) {
+        return new PopplerDocument( path );
+    }
+
+    /** Support via plugins */
+    QDocumentPluginInterface *plugin = findSupportedPlugin( path );
+
+    if ( plugin != nullptr ) {
+        /** nullptr if the plugin was not able to load the document */
+        return plugin->document( path );
+    }
+
+    qWarning() << "Unknown document type:" << path;
+    return nullptr;
+}
+
+
+bool QDocumentViewImpl::unlockDocument( QDocument *doc ) {
+    switch ( doc->error() ) {
+        case QDocument::NoError: {
+            return true;
+        }
+
+        case QDocument::IncorrectPasswordError: {
+            bool ok    = true;
+            int  count = 0;
+            do {
+                QString passwd = QInputDialog::getText(
+                    publ,
+                    "Encrypted Document",
+                    QString( "%1Please enter the document password:" ).arg( count ? "You may have entered the wrong password.<br>" : "" ),
+                    QLineEdit::Password,
+                    QString(),
+                    &ok,
+                    Qt::WindowFlags(),
+                    Qt::ImhSensitiveData
+                );
+
+                doc->setPassword( passwd );
+                count++;
+            } while ( ok == true and doc->passwordNeeded() );
+
+            /* User cancelled loading the document */
+            return ok;
+        }
+
+        default: {
+            return false;
+        }
+    }
+}
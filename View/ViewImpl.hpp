@@ -22,6 +22,7 @@
 #pragma once
 
 #include <QThread>
+#include <QTimer>
 #include <QPointer>
 #include <qdocumentview/QDocumentPrintOptions.hpp>
 #include <qdocumentview/QDocumentPluginInterface.hpp>
@@ -42,8 +43,45 @@ class QDocumentViewImpl {
         void setViewport( QRect viewport );
         void updateScrollBars();
 
+        /** Track the direction and speed of scrolling; @dy as in scrollContentsBy(...) */
+        void updateScrollVelocity( int dy );
+
+        /** First and last pages intersecting the viewport; (-1, -1) if there are none */
+        QPair<int, int> visiblePageRange() const;
+
+        /**
+         * Tell the renderer which pages are visible, so that they are rendered first,
+         * and which to prefetch: the pages around the viewport, biased along the scroll direction.
+         */
+        void updateRenderPriorities();
+
         void invalidateDocumentLayout();
 
+        /** Pixels per point of the screen showing the view; the layout is computed with it */
+        qreal logicalResolution() const;
+
+        /** What a resize did to the layout */
+        enum ResizeLayout {
+            RelayoutNow,        // There was nothing to scale from: compute the layout now
+            RelayoutLater,      // Scaled, or kept as is: compute the exact layout once the resizing stops
+            LayoutExact         // The layout is that of the new size already
+        };
+
+        /**
+         * The viewport was resized from @oldSize: in the fit modes, scale the current layout
+         * uniformly, and compute the exact layout once the resizing stops.
+         */
+        ResizeLayout scaleDocumentLayout( QSize oldSize );
+
+        /**
+         * The zoom is being changed by the wheel: paint the cached images scaled, and
+         * render afresh only once the zoom has been left alone for a while.
+         */
+        void zoomGestureStep();
+
+        /** Account the time (in microseconds) a paintEvent(...) took */
+        void recordFrameTime( qint64 usecs );
+
         qreal yPositionForPage( int page ) const;
 
         qreal zoomFactor() const;
@@ -55,9 +93,45 @@ class QDocumentViewImpl {
         /** Reverse zoom means reduce the zoom */
         qreal getNextZoomFactor( bool reverse ) const;
 
+        /**
+         * Geometries of the laid out pages: a contiguous array, in page order.
+         * The tops never decrease with the page number, and we keep the running
+         * maximum of the bottom edges: the pages in a band of y are found by binary search.
+         */
+        class PageGeometries {
+            public:
+                /** Start afresh; the first page to be laid out is @first */
+                void reset( int first );
+
+                /** Compute the search index: call once all the rects are set */
+                void finalize();
+
+                bool contains( int page ) const;
+
+                /** Geometry of @page; a null rect if it's not laid out */
+                QRect value( int page ) const;
+
+                /** Geometry of @page, for the layout functions: the array grows as needed */
+                QRect& operator[]( int page );
+
+                /** First and last pages intersecting the rows from @top to @bottom; (-1, -1) if there are none */
+                QPair<int, int> pagesBetween( int top, int bottom ) const;
+
+                /** Scale the whole layout by @factor, till the next reset(): a provisional layout */
+                void scale( qreal factor );
+                bool isScaled() const;
+
+            private:
+                int mFirstPage = 0;
+                qreal mScale   = 1.0;
+
+                QVector<QRect> mRects;
+                QVector<int> mMaxBottoms;
+        };
+
         struct DocumentLayout {
-            QSize             documentSize;
-            QHash<int, QRect> pageGeometries;
+            QSize          documentSize;
+            PageGeometries pageGeometries;
         };
 
         struct DocumentState {
@@ -101,7 +175,11 @@ class QDocumentViewImpl {
          */
         QPair<int, int> getCurrentSearchPosition();
 
-        void paintOverlayRects( int, QImage& );
+        /** Paint the search rects of @page, laid out at @pageGeometry, with the viewport @painter */
+        void paintOverlayRects( QPainter& painter, int page, QRect pageGeometry );
+
+        /** Paint the tiles of @page that intersect the viewport */
+        void paintPageTiles( QPainter&, int page, QRect pageGeometry );
 
         /**
          * We can have two cases:
@@ -131,6 +209,12 @@ class QDocumentViewImpl {
         QStringList getPlugins();
         QDocumentPluginInterface * findSupportedPlugin( QString );
 
+        /** Create the document for @path: PDFs are built-in, others via plugins. nullptr if unsupported */
+        QDocument * createDocument( QString path );
+
+        /** Check the loaded @doc, asking for its password if needed. False if it could not be opened */
+        bool unlockDocument( QDocument *doc );
+
         /** Variables */
         QDocument *mDocument = nullptr;
         QDocumentNavigation *mPageNavigation = nullptr;
@@ -152,6 +236,7 @@ class QDocumentViewImpl {
 
         QMetaObject::Connection mDocumentStatusChangedConnection;
         QMetaObject::Connection mReloadDocumentConnection;
+        QMetaObject::Connection mPageSizesChangedConnection;
 
         QRect mViewPort;
 
@@ -165,8 +250,29 @@ class QDocumentViewImpl {
 
         QDocumentView *publ;
 
-        qreal mScreenResolution; // pixels per point
-        bool pendingResize = false;
+        qreal mScreenResolution; // pixels per point, of the current layout
+
+        /** Scroll tracking for prefetch: +1 is down, -1 is up; velocity is in px/ms */
+        QElapsedTimer mScrollTimer;
+        int mScrollDirection  = 1;
+        qreal mScrollVelocity = 0.0;
+
+        /** Set while a zoom gesture is in progress; cleared when @mZoomSettleTimer fires */
+        QTimer *mZoomSettleTimer;
+        bool mZooming = false;
+
+        /** Computes the exact layout after the layout was scaled */
+        QTimer *mRelayoutTimer;
+
+        /** Scroll the painted contents instead of repainting the whole viewport */
+        bool mScrollBlitting = true;
+
+        /** Bumped by every load: a background load that finishes after a newer one is dropped */
+        quint64 mLoadGeneration = 0;
+
+        /** Paint cost in microseconds: the last frame, and an exponential moving average */
+        qint64 mLastFrameTime   = 0;
+        qreal mAverageFrameTime = 0.0;
 };
 
 
@@ -41,6 +41,7 @@ class PopplerDocument : public QDocument {
 
     public:
         PopplerDocument( QString pdfPath );
+        ~PopplerDocument();
 
         /* Set a password */
         void setPassword( QString password );
@@ -57,13 +58,16 @@ class PopplerDocument : public QDocument {
         void close();
 
     private:
+        /* Create the pages of the document */
+        void createPages();
+
         /* Pointer to our actual poppler document */
         std::unique_ptr<Poppler::Document> mPdfDoc;
 };
 
 class PdfPage : public QDocumentPage {
     public:
-        PdfPage( int );
+        PdfPage( int, Poppler::Document *doc );
         ~PdfPage();
 
         /* Way to store Poppler::Page */
@@ -80,6 +84,10 @@ class PdfPage : public QDocumentPage {
         QImage render( qreal zoomFactor, QDocumentRenderOptions ) const;
         QImage render( int dpiX, int dpiY, QDocumentRenderOptions ) const;
 
+        /* Render only a part of the page */
+        QImage renderTile( QSize, QRect tile, QDocumentRenderOptions ) const;
+        bool canRenderTiles() const;
+
         /* Page Text */
         QString pageText() const;
 
@@ -89,6 +97,16 @@ class PdfPage : public QDocumentPage {
         /* Search for @query in @pageNo or all pages */
         QList<QRectF> search( QString query, QDocumentRenderOptions ) const;
 
+        /* Text of the page, and the boxes of its characters */
+        bool hasTextLayout() const;
+        QDocumentPageText textLayout() const;
+
     private:
-        std::unique_ptr<Poppler::Page> m_page;
+        /* The Poppler::Page, created when it's first needed */
+        Poppler::Page * popplerPage() const;
+
+        Poppler::Document *mPdfDoc;
+
+        mutable std::unique_ptr<Poppler::Page> m_page;
+        mutable QMutex mPageLock;
 };
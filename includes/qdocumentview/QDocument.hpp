@@ -30,6 +30,14 @@
 class QDocumentPage;
 typedef QList<QDocumentPage *> QDocumentPages;
 
+class TextIndex;
+
+/* Text of a page, and the bounding box (in points) of each of its characters */
+struct QDocumentPageText {
+    QString         text;
+    QVector<QRectF> boxes;
+};
+
 class QDocument : public QObject {
     Q_OBJECT;
 
@@ -64,7 +72,7 @@ class QDocument : public QObject {
         Q_ENUM( MetaDataField );
 
         QDocument( QString docPath );
-        virtual ~QDocument() = default;
+        virtual ~QDocument();
 
         /* Check if a password is needed */
         virtual bool passwordNeeded() const;
@@ -72,6 +80,9 @@ class QDocument : public QObject {
         /* Set a password */
         virtual void setPassword( QString password ) = 0;
 
+        /* Hash of the size, the modification time, the first and the last MiB of the file: identifies the contents in the caches */
+        static QString fingerprint( QString docPath );
+
         /* Document File Name and File Path */
         virtual QString fileName() const;
         virtual QString filePath() const;
@@ -90,6 +101,14 @@ class QDocument : public QObject {
         /* Size of the page */
         QSizeF pageSize( int pageNo ) const;
 
+        /**
+         * Sizes of all the pages at zoom 1.0, in page order.
+         * Only page 0 is queried on first use: the other pages get its size until a background thread
+         * has read theirs, and pageSizesChanged() is emitted as they arrive. The table is cleared when
+         * the document reloads. Safe to call from any thread.
+         */
+        QVector<QSizeF> pageSizes() const;
+
         /* Reload the current document */
         void reload();
 
@@ -115,9 +134,28 @@ class QDocument : public QObject {
         /* Search for @query in @pageNo or all pages */
         QList<QRectF> search( QString query, int pageNo, QDocumentRenderOptions opts ) const;
 
+        /**
+         * Keep the text of the pages, and the boxes of its characters, in memory: search(...)
+         * then looks the query up in it, instead of extracting the text again for every query.
+         * A page is indexed the first time it's searched, in the search threads.
+         * Disabled by default; pages whose backend cannot provide the boxes are not indexed.
+         */
+        bool textIndexEnabled() const;
+        void setTextIndexEnabled( bool );
+
+        /**
+         * Keep the text index in a file as well, under $XDG_CACHE_HOME/qdocumentview/text, named
+         * after the fingerprint of the document. The file is written once every page is indexed,
+         * and is memory-mapped when the same contents are opened again, in this session or a later one.
+         * When the file changes on disk, the index is rebuilt only if its fingerprint changed.
+         */
+        bool textIndexPersistent() const;
+        void setTextIndexPersistent( bool );
+
         qreal zoomForWidth( int pageNo, qreal width ) const;
         qreal zoomForHeight( int pageNo, qreal width ) const;
 
+        qreal zoom() const;
         void setZoom( qreal zoom );
 
     public Q_SLOTS:
@@ -128,7 +166,30 @@ class QDocument : public QObject {
         QString mDocPath;
         QDocumentPages mPages;
 
-        mutable QList<QRectF> searchRects;
+        /* Filled by pageSizes() and @mSizeReader, with @mPageSizesLock held */
+        mutable QVector<QSizeF> mPageSizes;
+        mutable QMutex mPageSizesLock;
+
+        /* Reads the sizes of pages 1..n-1; it stops once @mSizeGeneration moves on */
+        mutable QThread *mSizeReader = nullptr;
+        mutable QAtomicInt mSizeGeneration;
+
+        /* Stop the size reader and clear the table: call it before the pages are deleted */
+        void resetPageSizes();
+
+        /**
+         * Filled by search(...), when enabled. The search threads hold a reference while they use it:
+         * disabling the index only drops ours. Swapped and copied with @mTextIndexLock held.
+         */
+        QSharedPointer<TextIndex> mTextIndex;
+        mutable QMutex mTextIndexLock;
+        bool mPersistentIndex = false;
+
+        /* The current index, or null: a reference that outlives setTextIndexEnabled( false ) */
+        QSharedPointer<TextIndex> textIndex() const;
+
+        /* Where the persistent text indexes are kept */
+        static QString textIndexDirectory();
 
         qreal mZoom;
 
@@ -143,6 +204,9 @@ class QDocument : public QObject {
 
         void loading( int );
 
+        /* Some pages turned out to differ from the provisional size: emitted from the size reader */
+        void pageSizesChanged();
+
         void documentReloading();
         void documentReloaded();
 };
@@ -177,6 +241,29 @@ class QDocumentPage {
         /* Thumbnail of the page */
         virtual QImage thumbnail() const = 0;
 
+        /* Added after 1.0.0: after the older virtuals, so that their vtable slots do not move */
+
+        /**
+         * Render only the @tile of the page rendered at the given size.
+         * @tile is in the coordinates of the rendered (rotated) page.
+         * The default implementation renders the whole page and crops it.
+         */
+        virtual QImage renderTile( QSize, QRect tile, QDocumentRenderOptions ) const;
+
+        /**
+         * Check if renderTile(...) renders only the tile. False by default: the
+         * renderer then renders the page whole, instead of rendering it once per tile.
+         */
+        virtual bool canRenderTiles() const;
+
+        /**
+         * Text of the page, with the box of each character, for the text index.
+         * The default implementation has no boxes: hasTextLayout() returns false,
+         * and the page is always searched with search(...).
+         */
+        virtual bool hasTextLayout() const;
+        virtual QDocumentPageText textLayout() const;
+
     protected:
         int mPageNo = -1;
 };
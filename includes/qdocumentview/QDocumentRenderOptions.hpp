@@ -22,6 +22,7 @@
 #pragma once
 
 #include <QtCore/QObject>
+#include <QtCore/QHash>
 
 class QDocumentRenderOptions {
     public:
@@ -65,6 +66,12 @@ class QDocumentRenderOptions {
     private:
         friend inline bool operator==( QDocumentRenderOptions lhs, QDocumentRenderOptions rhs );
 
+#if QT_VERSION < QT_VERSION_CHECK( 6, 0, 0 )
+        friend inline uint qHash( QDocumentRenderOptions opts, uint seed );
+#else
+        friend inline size_t qHash( QDocumentRenderOptions opts, size_t seed );
+#endif
+
         struct Bits {
             quint32 renderFlags : 8;
             quint32 rotation    : 3;
@@ -88,4 +95,13 @@ inline bool operator!=( QDocumentRenderOptions lhs, QDocumentRenderOptions rhs )
 }
 
 
+#if QT_VERSION < QT_VERSION_CHECK( 6, 0, 0 )
+inline uint qHash( QDocumentRenderOptions opts, uint seed = 0 ) {
+#else
+inline size_t qHash( QDocumentRenderOptions opts, size_t seed = 0 ) {
+#endif
+    return qHash( opts.data, seed );
+}
+
+
 Q_DECLARE_METATYPE( QDocumentRenderOptions );
@@ -27,36 +27,180 @@
 
 #include <QDocumentRenderOptions.hpp>
 
+struct RenderKey;
 class RenderTask;
+class RenderQueue;
+class PageCache;
+class DiskCache;
 class QDocument;
 
 class QDocumentRenderer : public QObject {
     Q_OBJECT;
 
     public:
+        /* Higher priority requests are rendered first */
+        enum RenderPriority {
+            PrefetchPriority = 0,
+            ThumbnailPriority,
+            VisiblePriority,
+            PreviewPriority     // Quick previews of visible pages that are yet to be rendered
+        };
+        Q_ENUM( RenderPriority );
+
         QDocumentRenderer( QObject *parent = nullptr );
+        ~QDocumentRenderer();
 
         void setDocument( QDocument * );
-        QImage requestPage( int pg, QSize imgSz, QDocumentRenderOptions opts );
+
+        /**
+         * Pixel ratio of the screen the pages are shown on. Sizes passed to the renderer are
+         * in device independent pixels; the images are rendered with this many pixels per unit,
+         * and carry the ratio, so that QPainter draws them at their logical size.
+         */
+        qreal devicePixelRatio() const;
+        void setDevicePixelRatio( qreal dpr );
+
+        QImage requestPage( int pg, QSize imgSz, QDocumentRenderOptions opts, RenderPriority priority = VisiblePriority );
+
+        /**
+         * The viewport changed: requests for @pgs (page number -> visible part, in page coordinates)
+         * are rendered first. Tiles outside the visible parts, and other requests that are neither
+         * prefetches nor thumbnails, are withdrawn.
+         */
+        void setVisiblePages( QHash<int, QRect> pgs );
+
+        /**
+         * Speculatively render @pgs (page number -> image size) at low priority.
+         * Prefetches from an earlier call that are not in @pgs are cancelled.
+         */
+        void prefetchPages( QHash<int, QSize> pgs, QDocumentRenderOptions opts );
+
+        /* Number of pages to prefetch ahead of and behind the visible pages */
+        int prefetchAhead() const;
+        int prefetchBehind() const;
+        void setPrefetchRange( int ahead, int behind );
+
+        /* Pages whose area (in device pixels) exceeds this are rendered in tiles */
+        qint64 tileThreshold() const;
+        void setTileThreshold( qint64 pixels );
+
+        /* Check if page @pg, at size @imgSz, should be rendered in tiles: only if its backend renders parts of pages */
+        bool isTiled( int pg, QSize imgSz ) const;
+
+        /* Width and height of a tile */
+        int tileSize() const;
+
+        /**
+         * The cached image of page @pg closest in size to @imgSz, rendered with @opts; null if there is none.
+         * Nothing is rendered: meant to be scaled and painted while the zoom is changing.
+         */
+        QImage placeholderPage( int pg, QSize imgSz, QDocumentRenderOptions opts ) const;
+
+        /**
+         * Request the @tile (column, row) of page @pg rendered at @imgSz.
+         * A small render of the whole page is requested along with the first tiles:
+         * placeholderPage(...) returns it, to be painted under the tiles that are not ready.
+         */
+        QImage requestTile( int pg, QSize imgSz, QPoint tile, QDocumentRenderOptions opts );
 
         void reload();
 
+        /**
+         * Show a quick, low resolution preview of the visible pages that are not yet rendered.
+         * The preview is rendered at a quarter of the width and height, ahead of the page itself,
+         * and is returned (upscaled) by requestPage(...) until the page is ready.
+         */
+        bool progressivePreview() const;
+        void setProgressivePreview( bool );
+
+        /**
+         * Thread pool in which the pages are rendered. Each renderer has its own pool.
+         * Set a common pool to share it between renderers (say, the tabs of a viewer);
+         * set nullptr to return to the renderer's own pool.
+         */
+        QThreadPool * threadPool() const;
+        void setThreadPool( QThreadPool *pool );
+
+        /* Maximum number of render threads, of the current pool */
+        int renderThreadCount() const;
+        void setRenderThreadCount( int count );
+
+        /* Priority of the threads while they render our pages; InheritPriority leaves it unchanged */
+        QThread::Priority renderThreadPriority() const;
+        void setRenderThreadPriority( QThread::Priority priority );
+
+        /* Stack size of the render threads, of the current pool; applies to threads created later */
+        uint renderThreadStackSize() const;
+        void setRenderThreadStackSize( uint bytes );
+
+        /* Memory (in bytes) the rendered pages are allowed to occupy */
+        qint64 cacheBudget() const;
+        void setCacheBudget( qint64 bytes );
+
+        /* Memory (in bytes) currently occupied by the rendered pages */
+        qint64 cacheUsage() const;
+
+        /* Fraction of the page requests served from the cache */
+        qreal cacheHitRate() const;
+
+        /**
+         * Keep the rendered pages on disk, under $XDG_CACHE_HOME/qdocumentview, to reuse them
+         * when the document is opened again. Disabled by default.
+         */
+        bool diskCacheEnabled() const;
+        void setDiskCacheEnabled( bool );
+
+        /**
+         * Disk space (in bytes) the cached pages of all documents may occupy: 1 GiB by default.
+         * The disk cache is shared by all the renderers of the process: so is its limit.
+         */
+        qint64 diskCacheLimit() const;
+        void setDiskCacheLimit( qint64 bytes );
+
     private:
         QDocument *mDoc;
-        qint64 validFrom = -1;
 
-        void validateImage( int pg, QImage img, qint64 id );
+        /* Requests are numbered sequentially: those made before @validFrom are stale */
+        qint64 validFrom = 0;
+        qint64 mNextId   = 1;
+
+        RenderTask * createTask( RenderKey key, QSize imgSz, QRect tile, QDocumentRenderOptions opts );
+        void validateImage( RenderKey key, QImage img, qint64 id );
+
+        /* Scale the nearest cached image of a page to @devSz device pixels, to stand in for it */
+        QImage scaledStandIn( QImage img, QSize devSz ) const;
+
+        /* Render tiled page @pg whole at a small size, if we have no other image of it, to stand in for its tiles */
+        void requestOverview( int pg, QSize imgSz, QDocumentRenderOptions opts );
+
+        /* 256 MiB by default */
+        PageCache *pageCache;
+
+        quint64 cacheHits   = 0;
+        quint64 cacheMisses = 0;
+
+        /* Second level cache, shared across sessions */
+        DiskCache *diskCache;
+
+        /* Pending requests, ordered by priority */
+        RenderQueue *renderQueue;
+
+        /* Our own thread pool, used unless another is shared with us */
+        QThreadPool *mOwnPool;
+        QThread::Priority mThreadPriority = QThread::InheritPriority;
+
+        /* Pages being prefetched, and their sizes */
+        QHash<int, QSize> mPrefetch;
+
+        /* 2048 x 2048 pixels by default */
+        qint64 mTileThreshold;
 
-        QHash<int, QImage> pageCache;
-        QVector<int> pages;
-        int pageCacheLimit = 20;
+        int mPrefetchAhead  = 3;
+        int mPrefetchBehind = 1;
 
-        QHash<int, RenderTask *> requestCache;
-        QVector<int> requests;
-        int requestLimit = 5;
+        bool mProgressivePreview = true;
 
-        QHash<int, RenderTask *> queuedRequests;
-        QVector<int> queue;
+        qreal mDevicePixelRatio = 1.0;
 
     Q_SIGNALS:
         void pageRendered( int );
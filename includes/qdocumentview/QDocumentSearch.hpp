@@ -47,21 +47,60 @@ class QDocumentSearch : public QThread {
         /** Stop the search, and hence the thread */
         void stop();
 
+        /**
+         * The pages are searched in chunks, by this many worker threads: QThread::idealThreadCount() by default.
+         * The results are still reported in reading order, starting with the requested page.
+         */
+        int searchThreadCount() const;
+        void setSearchThreadCount( int count );
+
     private:
         QDocument *mDoc;
         QString needle;
 
+        /** Workers that search the pages; this thread collects their results */
+        QThreadPool *mPool;
+
+        /** Plan the next run from the requested pages and the results so far, and start it */
+        void startRun();
+
+        /** Results of @pageNo handed over by the thread; dropped if @generation is not current */
+        void acceptResults( quint64 generation, int pageNo, QVector<QRectF> results );
+
+        /** The thread is done with its run: start again if pages were requested, or the string changed, meanwhile */
+        void acceptFinish( quint64 generation );
+
+        /** Pages requested by the user; touched only in the GUI thread */
         QStack<int> pages;
 
         int mStartPage = -1;
 
+        /** Pages to be searched by the current run, in reading order; fixed for the run */
+        QVector<int> mOrder;
+
+        /**
+         * What the current run searches, set by startRun(): a new search string does not wait
+         * for the run to give up, so the thread must not read @needle or @mDoc.
+         */
+        QString mRunNeedle;
+        QDocument *mRunDoc = nullptr;
+        quint64 mRunGeneration = 0;
+
+        /** Written only in the GUI thread, when the thread hands results over; results(...) may be called from any thread */
         QHash<int, QVector<QRectF> > mResults;
+        mutable QMutex mResultsLock;
+
+        /**
+         * Bumped with every run, and whenever the search string or the document changes.
+         * Results are tagged with the generation that produced them: stale ones are dropped.
+         */
+        QAtomicInteger<quint64> mGeneration;
 
         /** Stop completely */
-        bool mStop;
+        QAtomicInt mStop;
 
         /** Stop-other-loops-and-do-this_page flag */
-        bool stop_others;
+        QAtomicInt stop_others;
 
         /** Matches found so far */
         int matchCount;
@@ -77,6 +116,7 @@ class QDocumentSearch : public QThread {
         void matchesFound( int );
         void searchComplete( int numMatches );
 
-        /** Internal signal - used for prioritizing a particular page */
-        void pendingRestart();
+        /** Internal signals - the thread hands its results over to the GUI thread */
+        void pageSearched( quint64 generation, int pageNo, QVector<QRectF> );
+        void runFinished( quint64 generation );
 };
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <QtCore/qpointer.h>
 #include <QtWidgets/qabstractscrollarea.h>
 
 #include <QDocument.hpp>
@@ -71,10 +72,20 @@ class QDocumentView : public QAbstractScrollArea {
 
         QDocument * load( QString );
 
+        /**
+         * Open the document at @path in a worker thread, and show it once it's ready.
+         * The document is returned at once (still loading), or null if its type is not supported.
+         * The view owns it: it is deleted if it could not be opened (documentLoadingFailed() is
+         * emitted), or if another document is loaded before it's ready. The returned pointer
+         * becomes null then; documentChanged() tells when it's shown.
+         */
+        QPointer<QDocument> loadAsync( QString );
+
         void setDocument( QDocument *document );
         QDocument * document() const;
 
         QDocumentNavigation * pageNavigation() const;
+        QDocumentRenderer * pageRenderer() const;
 
         bool isLayoutContinuous() const;
         PageLayout pageLayout() const;
@@ -107,6 +118,17 @@ class QDocumentView : public QAbstractScrollArea {
 
         bool print( QPrinter *printer, QDocumentPrintOptions opts );
 
+        /**
+         * Scroll by moving the painted contents of the viewport, and painting only the exposed strip.
+         * Enabled by default; when disabled, the whole viewport is repainted on every scroll.
+         */
+        bool scrollBlitting() const;
+        void setScrollBlitting( bool );
+
+        /** Time (in microseconds) spent in the last paintEvent(...), and its running average */
+        qint64 lastFrameTime() const;
+        qreal averageFrameTime() const;
+
     public Q_SLOTS:
         void setLayoutContinuous( bool );
         void setPageLayout( PageLayout mode );